@@ -0,0 +1,146 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "avl_store.h"
+
+bool avl_store_init(struct avl_store* store){
+  struct avl_tree* tree = malloc(sizeof(struct avl_tree));
+
+  if(tree == NULL){
+    return false;
+  }
+
+  *tree = avl_create(0);
+
+  atomic_init(&store->current, tree);
+  atomic_init(&store->epoch, 0);
+  atomic_init(&store->readers[0], 0);
+  atomic_init(&store->readers[1], 0);
+
+  if(pthread_mutex_init(&store->write_lock, NULL) != 0){
+    free(tree);
+    return false;
+  }
+
+  return true;
+}
+
+void avl_store_destroy(struct avl_store* store){
+  struct avl_tree* tree = atomic_load(&store->current);
+
+  avl_destroy(tree);
+  free(tree);
+
+  pthread_mutex_destroy(&store->write_lock);
+}
+
+const struct avl_tree* avl_store_read_begin(struct avl_store* store, struct avl_store_reader* reader){
+  reader->slot = atomic_load(&store->epoch) & 1;
+  atomic_fetch_add(&store->readers[reader->slot], 1);
+
+  return atomic_load(&store->current);
+}
+
+void avl_store_read_end(struct avl_store* store, struct avl_store_reader reader){
+  atomic_fetch_sub(&store->readers[reader.slot], 1);
+}
+
+bool avl_store_lookup(struct avl_store* store, unsigned int key, struct tge_data* out){
+  struct avl_store_reader reader;
+  struct avl_tree* tree = (struct avl_tree*)avl_store_read_begin(store, &reader);
+
+  struct tge_data* data = avl_search(tree, key);
+
+  if(data != NULL){
+    *out = *data;
+  }
+
+  avl_store_read_end(store, reader);
+
+  return data != NULL;
+}
+
+//wait until no reader can still hold a tree that was swapped out before this
+//call. A reader may have read the epoch just before a flip, so both counters
+//are drained in turn, each after flipping new readers away from it
+static void wait_for_readers(struct avl_store* store){
+  for(int phase = 0; phase < 2; phase++){
+    unsigned int old_slot = atomic_fetch_add(&store->epoch, 1) & 1;
+
+    while(atomic_load(&store->readers[old_slot]) != 0){
+      sched_yield();
+    }
+  }
+}
+
+//swap in a new tree and free the old one once no reader is using it.
+//Called with the write lock held
+static void replace_tree(struct avl_store* store, struct avl_tree* tree){
+  struct avl_tree* old = atomic_exchange(&store->current, tree);
+
+  wait_for_readers(store);
+
+  avl_destroy(old);
+  free(old);
+}
+
+//copy the current tree for a writer to change. Called with the write lock held
+static struct avl_tree* copy_current(struct avl_store* store){
+  struct avl_tree* current = atomic_load(&store->current);
+  struct avl_tree* copy = malloc(sizeof(struct avl_tree));
+
+  if(copy == NULL){
+    return NULL;
+  }
+
+  *copy = avl_copy(current);
+
+  if(copy->size != current->size){
+    free(copy);
+    return NULL;
+  }
+
+  return copy;
+}
+
+bool avl_store_publish(struct avl_store* store, const struct avl_entry* entries, unsigned int count){
+  pthread_mutex_lock(&store->write_lock);
+
+  struct avl_tree* copy = copy_current(store);
+  bool inserted = copy != NULL;
+
+  for(unsigned int i = 0; i < count && inserted; i++){
+    inserted = avl_insert(copy, entries[i].key, entries[i].data);
+  }
+
+  if(inserted){
+    replace_tree(store, copy);
+  } else if(copy != NULL){
+    avl_destroy(copy);
+    free(copy);
+  }
+
+  pthread_mutex_unlock(&store->write_lock);
+
+  return inserted;
+}
+
+bool avl_store_remove(struct avl_store* store, const unsigned int* keys, unsigned int count){
+  pthread_mutex_lock(&store->write_lock);
+
+  struct avl_tree* copy = copy_current(store);
+
+  if(copy != NULL){
+    for(unsigned int i = 0; i < count; i++){
+      avl_remove(copy, keys[i]);
+    }
+
+    replace_tree(store, copy);
+  }
+
+  pthread_mutex_unlock(&store->write_lock);
+
+  return copy != NULL;
+}
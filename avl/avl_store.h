@@ -0,0 +1,41 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#include "avl_tree.h"
+
+//an asset index shared between threads. Readers never lock: writers copy the
+//current tree, change the copy and swap it in, then wait for readers of the
+//old tree to finish before freeing it. Writers are serialised by a mutex
+struct avl_store {
+  _Atomic(struct avl_tree*) current;
+  //readers announce themselves on the counter the epoch selects. A writer
+  //flips the epoch and waits for the other counter to drain
+  atomic_uint epoch;
+  atomic_uint readers[2];
+  pthread_mutex_t write_lock;
+};
+
+//token returned by avl_store_read_begin, passed back to avl_store_read_end
+struct avl_store_reader {
+  unsigned int slot;
+};
+
+bool avl_store_init(struct avl_store* store);
+//free the store. No other thread may be using it
+void avl_store_destroy(struct avl_store* store);
+
+//get the current tree for reading. It stays valid, and unchanged, until
+//avl_store_read_end. Keep read sections short, writers wait for them
+const struct avl_tree* avl_store_read_begin(struct avl_store* store, struct avl_store_reader* reader);
+void avl_store_read_end(struct avl_store* store, struct avl_store_reader reader);
+//copy the data for key into out. Return false if key is not in the store
+bool avl_store_lookup(struct avl_store* store, unsigned int key, struct tge_data* out);
+
+//insert or replace count entries and publish them together. Batching
+//entries amortises the copy of the tree. Return false on allocation failure
+bool avl_store_publish(struct avl_store* store, const struct avl_entry* entries, unsigned int count);
+//remove count keys and publish the result. Return false on allocation failure
+bool avl_store_remove(struct avl_store* store, const unsigned int* keys, unsigned int count);
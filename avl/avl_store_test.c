@@ -0,0 +1,141 @@
+#include "avl_tree.c"
+#include "avl_store.c"
+#include "avl_store.h"
+#include "../test.h"
+
+#define STORE_KEYS 20000
+#define STORE_BATCH 250
+#define STORE_READERS 4
+
+static char colours[STORE_KEYS];
+
+static struct tge_data key_data(unsigned int key){
+  struct tge_data data = { .colour = &colours[key] };
+  return data;
+}
+
+void test_general(){
+  puts("general testing");
+  struct avl_store store;
+
+  expect_int(avl_store_init(&store), 1, "store created");
+
+  struct tge_data data;
+
+  expect_int(avl_store_lookup(&store, 1, &data), 0, "empty store has no keys");
+
+  struct avl_entry entries[3] = {
+    { .key = 1, .data = key_data(1) },
+    { .key = 2, .data = key_data(2) },
+    { .key = 3, .data = key_data(3) }
+  };
+
+  expect_int(avl_store_publish(&store, entries, 3), 1, "publish succeeded");
+  expect_int(avl_store_lookup(&store, 2, &data) && data.colour == &colours[2], 1, "2 published, 2 found with its data");
+
+  unsigned int removed = 2;
+
+  expect_int(avl_store_remove(&store, &removed, 1), 1, "remove succeeded");
+  expect_int(avl_store_lookup(&store, 2, &data), 0, "2 removed, 2 not found");
+  expect_int(avl_store_lookup(&store, 3, &data), 1, "3 still found");
+
+  struct avl_store_reader reader;
+  const struct avl_tree* snapshot = avl_store_read_begin(&store, &reader);
+
+  expect_uint(snapshot->size, 2, "snapshot size");
+
+  avl_store_read_end(&store, reader);
+  avl_store_destroy(&store);
+}
+
+struct reader_state {
+  struct avl_store* store;
+  atomic_bool* done;
+  unsigned long long lookups;
+  unsigned long long wrong;
+};
+
+static void* reader_thread(void* arg){
+  struct reader_state* state = arg;
+  unsigned int key = 0;
+
+  while(!atomic_load(state->done)){
+    struct tge_data data;
+
+    //a key is either missing or found with its own data, never torn
+    if(avl_store_lookup(state->store, key, &data) && data.colour != &colours[key]){
+      state->wrong++;
+    }
+
+    state->lookups++;
+    key = (key + 7919) % STORE_KEYS;
+  }
+
+  return NULL;
+}
+
+void test_concurrent_readers(){
+  puts("testing readers alongside a writer");
+  struct avl_store store;
+  avl_store_init(&store);
+
+  atomic_bool done = false;
+  pthread_t threads[STORE_READERS];
+  struct reader_state states[STORE_READERS];
+
+  for(int i = 0; i < STORE_READERS; i++){
+    states[i] = (struct reader_state){ .store = &store, .done = &done };
+    pthread_create(&threads[i], NULL, reader_thread, &states[i]);
+  }
+
+  struct avl_entry entries[STORE_BATCH];
+  bool published = true;
+
+  for(unsigned int start = 0; start < STORE_KEYS; start += STORE_BATCH){
+    for(unsigned int i = 0; i < STORE_BATCH; i++){
+      entries[i] = (struct avl_entry){ .key = start + i, .data = key_data(start + i) };
+    }
+
+    published &= avl_store_publish(&store, entries, STORE_BATCH);
+  }
+
+  unsigned int keys[STORE_BATCH];
+
+  for(unsigned int start = 0; start < STORE_KEYS; start += STORE_BATCH * 2){
+    for(unsigned int i = 0; i < STORE_BATCH; i++){
+      keys[i] = start + i;
+    }
+
+    published &= avl_store_remove(&store, keys, STORE_BATCH);
+  }
+
+  atomic_store(&done, true);
+
+  unsigned long long lookups = 0;
+  unsigned long long wrong = 0;
+
+  for(int i = 0; i < STORE_READERS; i++){
+    pthread_join(threads[i], NULL);
+    lookups += states[i].lookups;
+    wrong += states[i].wrong;
+  }
+
+  expect_int(published, 1, "every publish succeeded");
+  expect_int(lookups > 0, 1, "readers ran");
+  expect_uint64_t(wrong, 0, "no reader saw data for the wrong key");
+
+  struct avl_store_reader reader;
+  const struct avl_tree* snapshot = avl_store_read_begin(&store, &reader);
+
+  expect_uint(snapshot->size, STORE_KEYS / 2, "half the keys left");
+
+  avl_store_read_end(&store, reader);
+  avl_store_destroy(&store);
+}
+
+int main(){
+  test_general();
+  test_concurrent_readers();
+
+  return 0;
+}
@@ -1,198 +1,545 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "avl_tree.h"
 
-//TODO allow for realloc upon needing space
+//number of searches avl_search_batch runs side by side
+#define AVL_BATCH_WIDTH 8
 
-static inline unsigned int left_index(unsigned int index){
-  return index * 2 + 1;
+#if defined(__GNUC__)
+#define avl_prefetch(address) __builtin_prefetch(address)
+#else
+#define avl_prefetch(address)
+#endif
+
+struct avl_tree avl_create(unsigned int capacity){
+  struct avl_tree avl = { .root = AVL_NIL };
+
+  if(capacity > 0){
+    avl.tree = malloc(capacity * sizeof(struct avl_node));
+    avl.data = malloc(capacity * sizeof(struct tge_data));
+
+    if(avl.tree == NULL || avl.data == NULL){
+      free(avl.tree);
+      free(avl.data);
+      avl.tree = NULL;
+      avl.data = NULL;
+    } else {
+      avl.capacity = capacity;
+    }
+  }
+
+  return avl;
 }
 
-static inline unsigned int right_index(unsigned int index){
-  return index * 2 + 2;
+//nodes refer to each other by index, so copying the arrays copies the structure
+struct avl_tree avl_copy(const struct avl_tree* avl){
+  struct avl_tree copy = avl_create(avl->size);
+
+  if(avl->size == 0 || copy.capacity < avl->size){
+    return copy;
+  }
+
+  memcpy(copy.tree, avl->tree, avl->size * sizeof(struct avl_node));
+  memcpy(copy.data, avl->data, avl->size * sizeof(struct tge_data));
+
+  copy.size = avl->size;
+  copy.root = avl->root;
+
+  return copy;
 }
 
-static struct avl_node default_node = {
-  .height = -1,
-  .key = 0
+void avl_destroy(struct avl_tree* avl){
+  free(avl->tree);
+  free(avl->data);
+
+  *avl = (struct avl_tree){ .root = AVL_NIL };
+}
+
+static int compare_entries(const void* a, const void* b){
+  unsigned int key_a = ((const struct avl_entry*)a)->key;
+  unsigned int key_b = ((const struct avl_entry*)b)->key;
+
+  return key_a < key_b ? -1 : key_a > key_b;
+}
+
+//height of a subtree built from n sorted keys by always splitting at the middle
+static int built_height(unsigned int n){
+  int height = -1;
+
+  while(n > 0){
+    n >>= 1;
+    height++;
+  }
+
+  return height;
+}
+
+struct build_range {
+  unsigned int low;
+  unsigned int high;
+  unsigned int index;
 };
 
-struct avl_tree avl_create(unsigned int capacity){
-  struct avl_tree avl = { .capacity = capacity };
+struct avl_tree avl_create_from(struct avl_entry* entries, unsigned int count){
+  bool sorted = true;
+
+  for(unsigned int i = 1; i < count && sorted; i++){
+    sorted = entries[i - 1].key <= entries[i].key;
+  }
+
+  if(!sorted){
+    qsort(entries, count, sizeof(struct avl_entry), compare_entries);
+  }
+
+  unsigned int unique = 0;
+
+  for(unsigned int i = 0; i < count; i++){
+    if(unique > 0 && entries[unique - 1].key == entries[i].key){
+      entries[unique - 1] = entries[i];
+    } else {
+      entries[unique++] = entries[i];
+    }
+  }
+
+  struct avl_tree avl = avl_create(unique);
+
+  if(unique == 0 || avl.capacity < unique){
+    return avl;
+  }
+
+  struct build_range* queue = malloc(unique * sizeof(struct build_range));
+
+  if(queue == NULL){
+    return avl;
+  }
 
-  avl.tree = malloc(capacity * sizeof(struct avl_node));
+  //nodes are numbered breadth first, so the levels every search passes
+  //through sit together at the front of the array
+  unsigned int head = 0;
+  unsigned int tail = 0;
+  unsigned int next_index = 1;
 
-  for(unsigned int i = 0; i < capacity; i++){
-    avl.tree[i] = default_node;
+  queue[tail++] = (struct build_range){ .low = 0, .high = unique, .index = 0 };
+
+  while(head < tail){
+    struct build_range range = queue[head++];
+    unsigned int middle = range.low + (range.high - range.low - 1) / 2;
+
+    struct avl_node* node = &avl.tree[range.index];
+    node->key = entries[middle].key;
+    node->height = built_height(range.high - range.low);
+    node->left = AVL_NIL;
+    node->right = AVL_NIL;
+    avl.data[range.index] = entries[middle].data;
+
+    if(middle > range.low){
+      node->left = next_index;
+      queue[tail++] = (struct build_range){ .low = range.low, .high = middle, .index = next_index++ };
+    }
+    if(middle + 1 < range.high){
+      node->right = next_index;
+      queue[tail++] = (struct build_range){ .low = middle + 1, .high = range.high, .index = next_index++ };
+    }
   }
 
+  free(queue);
+
+  avl.root = 0;
+  avl.size = unique;
+
   return avl;
 }
 
-static int calculate_balance_factor(struct avl_tree* avl, unsigned int node_index){
-   struct avl_node* left = &avl->tree[left_index(node_index)];
-   struct avl_node* right = &avl->tree[right_index(node_index)];
+//double the node arrays, memory stays proportional to the number of keys
+static bool avl_grow(struct avl_tree* avl){
+  unsigned int capacity = avl->capacity > 0 ? avl->capacity * 2 : 16;
+
+  if(capacity <= avl->capacity || capacity == AVL_NIL){
+    return false;
+  }
+
+  struct avl_node* tree = realloc(avl->tree, capacity * sizeof(struct avl_node));
 
-   return left->height - right->height;
+  if(tree == NULL){
+    return false;
+  }
+
+  avl->tree = tree;
+
+  struct tge_data* data = realloc(avl->data, capacity * sizeof(struct tge_data));
+
+  if(data == NULL){
+    return false;
+  }
+
+  avl->data = data;
+  avl->capacity = capacity;
+
+  return true;
 }
 
-static void left_rotate(struct avl_tree* avl, unsigned int grandparent_index, struct avl_node* grandparent_node, struct avl_node* parent_node, struct avl_node* inserted_node){
-  unsigned int grandparent_key = grandparent_node->key;
+static inline int node_height(struct avl_tree* avl, unsigned int index){
+  return index == AVL_NIL ? -1 : avl->tree[index].height;
+}
 
-  grandparent_node->key = parent_node->key;
-  parent_node->key = inserted_node->key;
+static inline void update_height(struct avl_tree* avl, unsigned int index){
+  int left = node_height(avl, avl->tree[index].left);
+  int right = node_height(avl, avl->tree[index].right);
 
-  unsigned int grandparent_left_index = left_index(grandparent_index);
-  struct avl_node* new_left_child = &avl->tree[grandparent_left_index];
-  new_left_child->key = grandparent_key;
+  avl->tree[index].height = (left > right ? left : right) + 1;
+}
 
-  new_left_child->height = 0;
-  inserted_node->height = -1;
-  parent_node->height = 0;
-  grandparent_node->height = 1;
+static inline int calculate_balance_factor(struct avl_tree* avl, unsigned int index){
+  return node_height(avl, avl->tree[index].left) - node_height(avl, avl->tree[index].right);
 }
 
-static void right_rotate(struct avl_tree* avl, unsigned int grandparent_index, struct avl_node* grandparent_node, struct avl_node* parent_node, struct avl_node* inserted_node){
-  unsigned int grandparent_key = grandparent_node->key;
+//rotations relink whole nodes, so data always stays with its key.
+//both return the index of the new subtree root
+
+static unsigned int left_rotate(struct avl_tree* avl, unsigned int index){
+  unsigned int right = avl->tree[index].right;
+
+  avl->tree[index].right = avl->tree[right].left;
+  avl->tree[right].left = index;
+
+  update_height(avl, index);
+  update_height(avl, right);
+
+  return right;
+}
+
+static unsigned int right_rotate(struct avl_tree* avl, unsigned int index){
+  unsigned int left = avl->tree[index].left;
+
+  avl->tree[index].left = avl->tree[left].right;
+  avl->tree[left].right = index;
+
+  update_height(avl, index);
+  update_height(avl, left);
+
+  return left;
+}
+
+static unsigned int avl_balance(struct avl_tree* avl, unsigned int index){
+  update_height(avl, index);
+
+  int balance_factor = calculate_balance_factor(avl, index);
+
+  //tree is left heavy
+  if(balance_factor > 1){
+    //left child is right heavy, left right case
+    if(calculate_balance_factor(avl, avl->tree[index].left) < 0){
+      avl->tree[index].left = left_rotate(avl, avl->tree[index].left);
+    }
+
+    return right_rotate(avl, index);
+  }
+
+  //tree is right heavy
+  if(balance_factor < -1){
+    //right child is left heavy, right left case
+    if(calculate_balance_factor(avl, avl->tree[index].right) > 0){
+      avl->tree[index].right = right_rotate(avl, avl->tree[index].right);
+    }
 
-  grandparent_node->key = parent_node->key;
-  parent_node->key = inserted_node->key;
+    return left_rotate(avl, index);
+  }
 
-  unsigned int grandparent_right_index = right_index(grandparent_index);
-  struct avl_node* new_right_child = &avl->tree[grandparent_right_index];
-  new_right_child->key = grandparent_key;
+  return index;
+}
 
-  new_right_child->height = 0;
-  inserted_node->height = -1;
-  parent_node->height = 0;
-  grandparent_node->height = 1;
+//point the parent of a rebalanced subtree, or the root, at its new top node
+static void relink(struct avl_tree* avl, unsigned int* path, size_t depth, unsigned int old_index, unsigned int new_index){
+  if(depth == 0){
+    avl->root = new_index;
+  } else if(avl->tree[path[depth - 1]].left == old_index){
+    avl->tree[path[depth - 1]].left = new_index;
+  } else {
+    avl->tree[path[depth - 1]].right = new_index;
+  }
 }
 
-static void left_right_rotate(struct avl_tree* avl, unsigned int grandparent_index, struct avl_node* grandparent_node, unsigned int parent_index, struct avl_node* parent_node, struct avl_node* inserted_node){
-  //move inserted node to left of parent node
-  struct avl_node* parent_node_left = &avl->tree[left_index(parent_index)];
-  parent_node_left->height = -1;
-  parent_node_left->key = parent_node->key;
-  parent_node->key = inserted_node->key;
-  inserted_node->height = -1;
+//rebalance every node on the path from the deepest up to the root
+static void avl_rebalance_path(struct avl_tree* avl, unsigned int* path, size_t path_length){
+  for(size_t depth = path_length; depth-- > 0;){
+    unsigned int index = path[depth];
+    int old_height = avl->tree[index].height;
 
-  right_rotate(avl, grandparent_index, grandparent_node, parent_node, parent_node_left);
+    unsigned int new_index = avl_balance(avl, index);
+
+    if(new_index != index){
+      relink(avl, path, depth, index, new_index);
+    } else if(avl->tree[index].height == old_height){
+      //nothing above can change once a subtree keeps its height
+      break;
+    }
+  }
 }
 
-static void right_left_rotate(struct avl_tree* avl, unsigned int grandparent_index, struct avl_node* grandparent_node, unsigned int parent_index, struct avl_node* parent_node, struct avl_node* inserted_node){
-  //move inserted node to left of parent node
-  struct avl_node* parent_node_right = &avl->tree[right_index(parent_index)];
-  parent_node_right->height = -1;
-  parent_node_right->key = parent_node->key;
-  parent_node->key = inserted_node->key;
-  inserted_node->height = -1;
+bool avl_insert(struct avl_tree* avl, unsigned int key, struct tge_data value){
+  unsigned int path[AVL_MAX_HEIGHT];
+  size_t path_length = 0;
+
+  unsigned int i = avl->root;
+
+  while(i != AVL_NIL){
+    struct avl_node* cur_node = &avl->tree[i];
+
+    if(cur_node->key == key){
+      avl->data[i] = value;
+      return true;
+    }
+
+    path[path_length++] = i;
+    i = cur_node->key > key ? cur_node->left : cur_node->right;
+  }
+
+  if(avl->size == avl->capacity && !avl_grow(avl)){
+    return false;
+  }
+
+  unsigned int index = avl->size;
+
+  avl->tree[index] = (struct avl_node){
+    .key = key,
+    .height = 0,
+    .left = AVL_NIL,
+    .right = AVL_NIL
+  };
+  avl->data[index] = value;
+  avl->size++;
+
+  if(path_length == 0){
+    avl->root = index;
+    return true;
+  }
 
-  left_rotate(avl, grandparent_index, grandparent_node, parent_node, parent_node_right);
+  struct avl_node* parent = &avl->tree[path[path_length - 1]];
+
+  if(parent->key > key){
+    parent->left = index;
+  } else {
+    parent->right = index;
+  }
+
+  avl_rebalance_path(avl, path, path_length);
+
+  return true;
 }
 
-static void avl_balance(struct avl_tree* avl, unsigned int* visited_indices, size_t visited_indices_count){
-  if(visited_indices_count <= 2){
+//give back memory once the tree has shrunk to a quarter of its capacity
+static void avl_shrink(struct avl_tree* avl){
+  if(avl->capacity <= 16 || avl->size > avl->capacity / 4){
+    return;
+  }
+
+  unsigned int capacity = avl->capacity / 2;
+
+  //both arrays are replaced or neither, so capacity always fits both
+  struct avl_node* tree = malloc(capacity * sizeof(struct avl_node));
+  struct tge_data* data = malloc(capacity * sizeof(struct tge_data));
+
+  if(tree == NULL || data == NULL){
+    free(tree);
+    free(data);
     return;
   }
 
-  //the node 2 above inserted
-  unsigned int inserted_node_grandparent_index = visited_indices[visited_indices_count - 3];
-  struct avl_node* inserted_node_grandparent = &avl->tree[inserted_node_grandparent_index];
+  memcpy(tree, avl->tree, avl->size * sizeof(struct avl_node));
+  memcpy(data, avl->data, avl->size * sizeof(struct tge_data));
+  free(avl->tree);
+  free(avl->data);
 
-  //the node 1 above inserted
-  unsigned int inserted_node_parent_index = visited_indices[visited_indices_count - 2];
-  struct avl_node* inserted_node_parent = &avl->tree[inserted_node_parent_index];
+  avl->tree = tree;
+  avl->data = data;
+  avl->capacity = capacity;
+}
+
+//move the last node of the array into a freed slot so the array stays dense
+static void avl_compact(struct avl_tree* avl, unsigned int freed){
+  unsigned int last = avl->size - 1;
 
-  unsigned int inserted_node_index = visited_indices[visited_indices_count - 1];
-  struct avl_node* inserted_node = &avl->tree[inserted_node_index];
+  if(freed != last){
+    unsigned int key = avl->tree[last].key;
+    unsigned int parent = AVL_NIL;
+    unsigned int i = avl->root;
 
-  int balance_factor = calculate_balance_factor(avl, inserted_node_grandparent_index);
+    while(i != last){
+      parent = i;
+      i = avl->tree[i].key > key ? avl->tree[i].left : avl->tree[i].right;
+    }
+
+    if(parent == AVL_NIL){
+      avl->root = freed;
+    } else if(avl->tree[parent].left == last){
+      avl->tree[parent].left = freed;
+    } else {
+      avl->tree[parent].right = freed;
+    }
 
-  //tree is left heavy and was a left insertion
-  if(balance_factor > 1 && inserted_node_parent->key > inserted_node->key){
-    right_rotate(avl, inserted_node_grandparent_index, inserted_node_grandparent, inserted_node_parent, inserted_node);
+    avl->tree[freed] = avl->tree[last];
+    avl->data[freed] = avl->data[last];
   }
-  //tree is left heavy and was a right insertion
-  else if(balance_factor > 1){
-    left_right_rotate(avl, inserted_node_grandparent_index, inserted_node_grandparent, inserted_node_parent_index, inserted_node_parent, inserted_node);
+
+  avl->size--;
+  avl_shrink(avl);
+}
+
+bool avl_remove(struct avl_tree* avl, unsigned int key){
+  unsigned int path[AVL_MAX_HEIGHT];
+  size_t path_length = 0;
+
+  unsigned int i = avl->root;
+
+  while(i != AVL_NIL && avl->tree[i].key != key){
+    path[path_length++] = i;
+    i = avl->tree[i].key > key ? avl->tree[i].left : avl->tree[i].right;
   }
 
-  //tree is right heavy and was a right insertion
-  else if(balance_factor < -1 && inserted_node_parent->key < inserted_node->key){
-    left_rotate(avl, inserted_node_grandparent_index, inserted_node_grandparent, inserted_node_parent, inserted_node);
+  if(i == AVL_NIL){
+    return false;
   }
-  //tree is right heavy and was a left insertion
-  else if(balance_factor < -1){
-    right_left_rotate(avl, inserted_node_grandparent_index, inserted_node_grandparent, inserted_node_parent_index, inserted_node_parent, inserted_node);
+
+  //a node with two children takes the key and data of its successor,
+  //which is then removed instead. The successor has no left child
+  if(avl->tree[i].left != AVL_NIL && avl->tree[i].right != AVL_NIL){
+    unsigned int found = i;
+
+    path[path_length++] = i;
+    i = avl->tree[i].right;
+
+    while(avl->tree[i].left != AVL_NIL){
+      path[path_length++] = i;
+      i = avl->tree[i].left;
+    }
+
+    avl->tree[found].key = avl->tree[i].key;
+    avl->data[found] = avl->data[i];
   }
+
+  unsigned int child = avl->tree[i].left != AVL_NIL ? avl->tree[i].left : avl->tree[i].right;
+
+  relink(avl, path, path_length, i, child);
+  avl_rebalance_path(avl, path, path_length);
+  avl_compact(avl, i);
+
+  return true;
 }
 
-void avl_insert(struct avl_tree* avl, unsigned int key, struct tge_data value){
-  struct avl_node* cur_node;
+struct tge_data* avl_search(struct avl_tree* avl, unsigned int key){
+  unsigned int i = avl->root;
 
-  unsigned int visited_indices[avl->tree[0].height + 2];
-  size_t visited_indices_count = 0;
+  while(i != AVL_NIL){
+    struct avl_node* cur_node = &avl->tree[i];
 
-  unsigned int i = 0;
+    if(cur_node->key == key){
+      return &avl->data[i];
+    }
 
-  while(i < avl->capacity){
-    cur_node = &avl->tree[i];
-    visited_indices[visited_indices_count] = i;
-    visited_indices_count++;
+    i = cur_node->key > key ? cur_node->left : cur_node->right;
+  }
 
-    if(cur_node->height == -1){
-      cur_node->key = key;
-      cur_node->height = 0;
+  return NULL;
+}
 
-      avl->size++;
+void avl_search_batch(struct avl_tree* avl, const unsigned int* keys, unsigned int count, struct tge_data** results){
+  for(unsigned int start = 0; start < count; start += AVL_BATCH_WIDTH){
+    unsigned int width = count - start < AVL_BATCH_WIDTH ? count - start : AVL_BATCH_WIDTH;
+    unsigned int cursors[AVL_BATCH_WIDTH];
+    unsigned int active = width;
+
+    for(unsigned int lane = 0; lane < width; lane++){
+      cursors[lane] = avl->root;
+      results[start + lane] = NULL;
+    }
+
+    //advance every unfinished search one level per pass, prefetching the
+    //next node of each so their cache misses overlap
+    while(active > 0){
+      active = 0;
+
+      for(unsigned int lane = 0; lane < width; lane++){
+        unsigned int i = cursors[lane];
+
+        if(i == AVL_NIL){
+          continue;
+        }
 
-      for(size_t j = 1; j < visited_indices_count - 1; j++){
-        unsigned int visited_index = visited_indices[j];
-        struct avl_node* visited_node = &avl->tree[visited_index];
+        struct avl_node* cur_node = &avl->tree[i];
+        unsigned int key = keys[start + lane];
 
-        //if the current node already has a height greater than
-        //the tree after the new insertion, stop incrementing heights
-        if(visited_node->height >= j){
-          break;
+        if(cur_node->key == key){
+          results[start + lane] = &avl->data[i];
+          cursors[lane] = AVL_NIL;
+          continue;
         }
 
-        avl->tree[visited_indices[j]].height++;
+        i = cur_node->key > key ? cur_node->left : cur_node->right;
+        cursors[lane] = i;
+
+        if(i != AVL_NIL){
+          avl_prefetch(&avl->tree[i]);
+          active++;
+        }
       }
+    }
+  }
+}
 
-      avl_balance(avl, visited_indices, visited_indices_count);
+//push node and its chain of left children, skipping nodes below low
+static void iter_descend(struct avl_iter* iter, unsigned int index, bool bounded_low, unsigned int low){
+  struct avl_tree* avl = iter->avl;
 
-      break;
-    } else if(cur_node->key == key){
-      cur_node->data = value;
-    } else if(cur_node->key > key){
-      i = left_index(i);
-    } else if(cur_node->key < key){
-      i = right_index(i);
+  while(index != AVL_NIL){
+    if(bounded_low && avl->tree[index].key < low){
+      index = avl->tree[index].right;
+    } else {
+      iter->stack[iter->depth++] = index;
+      index = avl->tree[index].left;
     }
   }
 }
 
-struct tge_data* avl_search(struct avl_tree* avl, int key){
-  struct avl_node* cur_node;
+void avl_iter_begin(struct avl_tree* avl, struct avl_iter* iter){
+  iter->avl = avl;
+  iter->depth = 0;
+  iter->bounded = false;
+  iter->high = 0;
 
-  unsigned int i = 0;
+  iter_descend(iter, avl->root, false, 0);
+}
 
-  while(i < avl->capacity){
-    cur_node = &avl->tree[i];
+void avl_range_begin(struct avl_tree* avl, struct avl_iter* iter, unsigned int low, unsigned int high){
+  iter->avl = avl;
+  iter->depth = 0;
+  iter->bounded = true;
+  iter->high = high;
 
-    if(cur_node->height == -1){
-      return NULL;
-    } else if(cur_node->key == key){
-      return &cur_node->data;
-    } else if(cur_node->key > key){
-      i = left_index(i);
-    } else if(cur_node->key < key){
-      i = right_index(i);
-    }
+  if(low < high){
+    iter_descend(iter, avl->root, true, low);
   }
-
-  return NULL;
 }
 
+bool avl_iter_next(struct avl_iter* iter, unsigned int* key, struct tge_data** data){
+  if(iter->depth == 0){
+    return false;
+  }
+
+  unsigned int index = iter->stack[--iter->depth];
+  struct avl_node* node = &iter->avl->tree[index];
+
+  if(iter->bounded && node->key >= iter->high){
+    iter->depth = 0;
+    return false;
+  }
+
+  iter_descend(iter, node->right, false, 0);
+
+  *key = node->key;
+  *data = &iter->avl->data[index];
+
+  return true;
+}
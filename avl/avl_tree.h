@@ -1,11 +1,28 @@
 #pragma once
 
+#include <limits.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #include "../tge_asset.h"
 
+//index used for a missing child or an empty tree
+#define AVL_NIL UINT_MAX
+
+//an AVL tree of 2^32 nodes is at most ~46 levels high
+#define AVL_MAX_HEIGHT 64
+
+//nodes live in one growable array and refer to each other by index.
+//key and links are kept apart from the data so searches touch as few
+//cache lines as possible
 struct avl_node {
+  unsigned int key;
   int height;
+  unsigned int left;
+  unsigned int right;
+};
+
+struct avl_entry {
   unsigned int key;
   struct tge_data data;
 };
@@ -13,10 +30,38 @@ struct avl_node {
 struct avl_tree {
   unsigned int capacity;
   unsigned int size;
+  unsigned int root;
   struct avl_node* tree;
+  struct tge_data* data;
 };
 
-struct avl_tree avl_create(unsigned int capacity);
-void avl_insert(struct avl_tree* avl, unsigned int key, struct tge_data value);
-struct tge_data* avl_search(struct avl_tree* avl, int key);
+//in order traversal state. The tree must not be modified while iterating
+struct avl_iter {
+  struct avl_tree* avl;
+  unsigned int stack[AVL_MAX_HEIGHT];
+  unsigned int depth;
+  bool bounded;
+  unsigned int high;
+};
 
+struct avl_tree avl_create(unsigned int capacity);
+//make an independent copy of a tree. On allocation failure the copy is empty
+struct avl_tree avl_copy(const struct avl_tree* avl);
+//free the tree's memory and leave it empty
+void avl_destroy(struct avl_tree* avl);
+//build a balanced tree from entries in one pass. entries is sorted in place.
+//for duplicate keys only one entry is kept, which one is unspecified
+struct avl_tree avl_create_from(struct avl_entry* entries, unsigned int count);
+bool avl_insert(struct avl_tree* avl, unsigned int key, struct tge_data value);
+//remove key and its data. Return false if key was not in the tree
+bool avl_remove(struct avl_tree* avl, unsigned int key);
+struct tge_data* avl_search(struct avl_tree* avl, unsigned int key);
+//look up count keys at once, interleaving the searches so memory fetches
+//overlap. results[i] is set to the data for keys[i] or NULL
+void avl_search_batch(struct avl_tree* avl, const unsigned int* keys, unsigned int count, struct tge_data** results);
+//start iterating over every key in ascending order
+void avl_iter_begin(struct avl_tree* avl, struct avl_iter* iter);
+//start iterating over the keys in [low, high) in ascending order
+void avl_range_begin(struct avl_tree* avl, struct avl_iter* iter, unsigned int low, unsigned int high);
+//get the next key and its data. Return false once there are no more
+bool avl_iter_next(struct avl_iter* iter, unsigned int* key, struct tge_data** data);
@@ -0,0 +1,307 @@
+//asset index benchmark and randomised stress test.
+//build with: gcc -O2 -o avl_tree_bench avl_tree_bench.c
+//run with: ./avl_tree_bench bench [max keys]
+//      or: ./avl_tree_bench stress [operations] [seed]
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "avl_tree.c"
+#include "avl_tree.h"
+
+#define DEFAULT_MAX_KEYS 10000000
+#define DEFAULT_STRESS_OPERATIONS 200000
+#define LOOKUPS 1000000
+#define BATCH_SIZE 64
+
+//keys in the stress test stay below this so the tree is small enough to
+//validate completely after every operation, and keys repeat often
+#define STRESS_KEY_RANGE 4096
+
+enum distribution {
+  SEQUENTIAL,
+  RANDOM,
+  SKEWED
+};
+
+static const char* distribution_names[] = { "sequential", "random", "skewed" };
+
+static uint64_t random_state;
+
+//xorshift64*, fixed seed so every run uses the same keys
+static uint64_t next_random(void){
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return random_state * 0x2545F4914F6CDD1DULL;
+}
+
+static unsigned long long now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//data that can be traced back to the key it was stored under
+static char markers[STRESS_KEY_RANGE];
+
+static struct tge_data key_data(unsigned int key){
+  struct tge_data data = { .colour = &markers[key % STRESS_KEY_RANGE] };
+  return data;
+}
+
+//skewed keys cluster in a few dense runs, like asset ids handed out in
+//batches per level
+static unsigned int make_key(enum distribution distribution, unsigned int i){
+  switch(distribution){
+    case SEQUENTIAL:
+      return i;
+    case RANDOM:
+      return (unsigned int)next_random();
+    case SKEWED:
+      return (unsigned int)(next_random() % 16) * 0x10000000u + i;
+  }
+
+  return i;
+}
+
+//most lookups in a skewed run go to a small set of hot keys
+static unsigned int lookup_index(enum distribution distribution, unsigned int count){
+  double u = (double)(next_random() >> 11) / (double)(1ULL << 53);
+
+  if(distribution == SKEWED){
+    u = u * u * u;
+  }
+
+  return (unsigned int)(u * count);
+}
+
+static void bench(unsigned int count, enum distribution distribution){
+  unsigned int* keys = malloc(count * sizeof(unsigned int));
+  unsigned int* lookups = malloc(LOOKUPS * sizeof(unsigned int));
+  struct tge_data** results = malloc(BATCH_SIZE * sizeof(struct tge_data*));
+
+  if(keys == NULL || lookups == NULL || results == NULL){
+    free(keys);
+    free(lookups);
+    free(results);
+    puts("out of memory");
+    return;
+  }
+
+  random_state = 0x9E3779B97F4A7C15ULL;
+
+  for(unsigned int i = 0; i < count; i++){
+    keys[i] = make_key(distribution, i);
+  }
+  for(unsigned int i = 0; i < LOOKUPS; i++){
+    lookups[i] = keys[lookup_index(distribution, count)];
+  }
+
+  struct avl_tree avl = avl_create(16);
+
+  unsigned long long start = now_ns();
+
+  for(unsigned int i = 0; i < count; i++){
+    avl_insert(&avl, keys[i], key_data(keys[i]));
+  }
+
+  unsigned long long insert_ns = now_ns() - start;
+
+  unsigned int found = 0;
+  start = now_ns();
+
+  for(unsigned int i = 0; i < LOOKUPS; i++){
+    found += avl_search(&avl, lookups[i]) != NULL;
+  }
+
+  unsigned long long search_ns = now_ns() - start;
+  start = now_ns();
+
+  for(unsigned int i = 0; i < LOOKUPS; i += BATCH_SIZE){
+    unsigned int batch = LOOKUPS - i < BATCH_SIZE ? LOOKUPS - i : BATCH_SIZE;
+    avl_search_batch(&avl, &lookups[i], batch, results);
+    found += results[0] != NULL;
+  }
+
+  unsigned long long batch_ns = now_ns() - start;
+
+  //nodes and data live in two arrays sized to the capacity
+  size_t bytes = (size_t)avl.capacity * (sizeof(struct avl_node) + sizeof(struct tge_data));
+
+  printf("%10u %-10s %8.1f ns/insert %8.1f ns/search %8.1f ns/batched %12zu bytes %6.1f bytes/key%s\n",
+    count,
+    distribution_names[distribution],
+    (double)insert_ns / count,
+    (double)search_ns / LOOKUPS,
+    (double)batch_ns / LOOKUPS,
+    bytes,
+    (double)bytes / avl.size,
+    found < LOOKUPS ? " MISSING KEYS" : "");
+
+  avl_destroy(&avl);
+  free(keys);
+  free(lookups);
+  free(results);
+}
+
+static int subtree_height(struct avl_tree* avl, unsigned int index, long long low, long long high, bool* valid){
+  if(index == AVL_NIL){
+    return -1;
+  }
+
+  struct avl_node* node = &avl->tree[index];
+
+  if(index >= avl->size || node->key <= low || node->key >= high){
+    *valid = false;
+    return 0;
+  }
+
+  int left = subtree_height(avl, node->left, low, node->key, valid);
+  int right = subtree_height(avl, node->right, node->key, high, valid);
+  int height = (left > right ? left : right) + 1;
+
+  if(node->height != height || left - right > 1 || right - left > 1){
+    *valid = false;
+  }
+
+  return height;
+}
+
+//check ordering, balance and stored heights, that the tree holds exactly
+//the keys in present, and that every key still has its own data
+static bool tree_matches(struct avl_tree* avl, const bool* present, unsigned int count){
+  bool valid = true;
+
+  subtree_height(avl, avl->root, -1, (long long)UINT_MAX + 1, &valid);
+
+  if(!valid || avl->size != count || avl->size > avl->capacity){
+    return false;
+  }
+
+  struct avl_iter iter;
+  unsigned int key;
+  struct tge_data* data;
+  unsigned int seen = 0;
+
+  avl_iter_begin(avl, &iter);
+
+  while(avl_iter_next(&iter, &key, &data)){
+    if(key >= STRESS_KEY_RANGE || !present[key] || data->colour != &markers[key]){
+      return false;
+    }
+
+    seen++;
+  }
+
+  return seen == count;
+}
+
+static int stress(unsigned long operations, uint64_t seed){
+  bool present[STRESS_KEY_RANGE] = { 0 };
+  unsigned int count = 0;
+  struct avl_tree avl = avl_create(1);
+
+  random_state = seed != 0 ? seed : 1;
+
+  for(unsigned long op = 0; op < operations; op++){
+    //a smaller key range now and then makes removals and duplicates likelier
+    unsigned int range = next_random() % 8 == 0 ? 64 : STRESS_KEY_RANGE;
+    unsigned int key = next_random() % range;
+    unsigned int action = next_random() % 10;
+    const char* name;
+
+    if(action < 5){
+      name = "insert";
+
+      if(!avl_insert(&avl, key, key_data(key))){
+        printf("insert of %u failed\n", key);
+        avl_destroy(&avl);
+        return 1;
+      }
+
+      count += !present[key];
+      present[key] = true;
+    } else if(action < 8){
+      name = "remove";
+
+      if(avl_remove(&avl, key) != present[key]){
+        printf("operation %lu: remove of %u returned the wrong result\n", op, key);
+        avl_destroy(&avl);
+        return 1;
+      }
+
+      count -= present[key];
+      present[key] = false;
+    } else if(action < 9){
+      name = "search";
+
+      struct tge_data* data = avl_search(&avl, key);
+
+      if((data != NULL) != present[key] || (data != NULL && data->colour != &markers[key])){
+        printf("operation %lu: search for %u returned the wrong result\n", op, key);
+        avl_destroy(&avl);
+        return 1;
+      }
+    } else {
+      name = "batch search";
+
+      unsigned int keys[BATCH_SIZE];
+      struct tge_data* results[BATCH_SIZE];
+
+      for(unsigned int i = 0; i < BATCH_SIZE; i++){
+        keys[i] = (key + i * 37) % STRESS_KEY_RANGE;
+      }
+
+      avl_search_batch(&avl, keys, BATCH_SIZE, results);
+
+      for(unsigned int i = 0; i < BATCH_SIZE; i++){
+        if((results[i] != NULL) != present[keys[i]] || (results[i] != NULL && results[i]->colour != &markers[keys[i]])){
+          printf("operation %lu: batch search for %u returned the wrong result\n", op, keys[i]);
+          avl_destroy(&avl);
+          return 1;
+        }
+      }
+    }
+
+    if(!tree_matches(&avl, present, count)){
+      printf("operation %lu: tree invalid after %s of %u\n", op, name, key);
+      avl_destroy(&avl);
+      return 1;
+    }
+  }
+
+  printf("%lu operations, %u keys left, tree valid after every operation\n", operations, count);
+  avl_destroy(&avl);
+
+  return 0;
+}
+
+int main(int argc, char** argv){
+  const char* mode = argc > 1 ? argv[1] : "bench";
+
+  if(strcmp(mode, "stress") == 0){
+    unsigned long operations = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_STRESS_OPERATIONS;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], NULL, 10) : (uint64_t)time(NULL);
+
+    printf("stress seed %llu\n", (unsigned long long)seed);
+
+    return stress(operations, seed);
+  }
+
+  if(strcmp(mode, "bench") != 0){
+    fprintf(stderr, "usage: %s bench [max keys] | stress [operations] [seed]\n", argv[0]);
+    return 1;
+  }
+
+  unsigned long max_keys = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_MAX_KEYS;
+
+  for(unsigned long count = 1000; count <= max_keys; count *= 10){
+    for(int distribution = SEQUENTIAL; distribution <= SKEWED; distribution++){
+      bench(count, distribution);
+    }
+  }
+
+  return 0;
+}
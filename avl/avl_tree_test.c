@@ -1,4 +1,29 @@
+#include <stdlib.h>
+
+//lets a test make an allocation in the tree fail, -1 never fails
+static int allocations_until_failure = -1;
+
+static void* failing_malloc(size_t size){
+  if(allocations_until_failure >= 0 && allocations_until_failure-- == 0){
+    return NULL;
+  }
+
+  return malloc(size);
+}
+
+static void* failing_realloc(void* pointer, size_t size){
+  if(allocations_until_failure >= 0 && allocations_until_failure-- == 0){
+    return NULL;
+  }
+
+  return realloc(pointer, size);
+}
+
+#define malloc(size) failing_malloc(size)
+#define realloc(pointer, size) failing_realloc(pointer, size)
 #include "avl_tree.c"
+#undef malloc
+#undef realloc
 #include "avl_tree.h"
 #include "../test.h"
 
@@ -6,6 +31,26 @@ struct tge_data test_data =  {
   .colour = "\x1B[1;31m"
 };
 
+static char colours[10000];
+
+//data that can be traced back to the key it was inserted with
+static struct tge_data key_data(unsigned int key){
+  struct tge_data data = { .colour = &colours[key] };
+  return data;
+}
+
+static struct avl_node* root_node(struct avl_tree* avl){
+  return &avl->tree[avl->root];
+}
+
+static struct avl_node* left_of(struct avl_tree* avl, struct avl_node* node){
+  return &avl->tree[node->left];
+}
+
+static struct avl_node* right_of(struct avl_tree* avl, struct avl_node* node){
+  return &avl->tree[node->right];
+}
+
 void test_general(){
   puts("general testing");
   struct avl_tree avl = avl_create(10);
@@ -13,11 +58,11 @@ void test_general(){
   expect_uint(avl.capacity, 10, "capacity");
   expect_uint(avl.size, 0, "size");
 
-  expect_int(avl.tree[0].height, -1, "empty node has height of -1");
+  expect_uint(avl.root, AVL_NIL, "empty tree has no root");
 
   avl_insert(&avl, 5, test_data);
 
-  expect_int(avl.tree[0].height, 0, "filled node has height of 0");
+  expect_int(root_node(&avl)->height, 0, "filled node has height of 0");
 
   expect_int(avl_search(&avl, 5) != NULL, 1, "5 inserted, 5 found");
   expect_int(avl_search(&avl, 1) == NULL, 1, "1 not inserted, 1 not found");
@@ -25,17 +70,19 @@ void test_general(){
   avl_insert(&avl, 4, test_data);
 
   expect_int(avl_search(&avl, 4) != NULL, 1, "4 inserted, 4 found");
-  expect_int(avl.tree[left_index(0)].key, 4, "4 to the left of 5");
+  expect_int(left_of(&avl, root_node(&avl))->key, 4, "4 to the left of 5");
 
   avl_insert(&avl, 7, test_data);
 
   expect_int(avl_search(&avl, 7) != NULL, 1, "7 inserted, 7 found");
-  expect_int(avl.tree[right_index(0)].key, 7, "7 to the right of 5");
+  expect_int(right_of(&avl, root_node(&avl))->key, 7, "7 to the right of 5");
 
   avl_insert(&avl, 10, test_data);
 
   expect_int(avl_search(&avl, 10) != NULL, 1, "10 inserted, 10 found");
-  expect_int(avl.tree[right_index(right_index(0))].key, 10, "10 to the right of 7");
+  expect_int(right_of(&avl, right_of(&avl, root_node(&avl)))->key, 10, "10 to the right of 7");
+
+  avl_destroy(&avl);
 }
 
 void test_right_rotate(){
@@ -45,15 +92,17 @@ void test_right_rotate(){
   avl_insert(&avl, 3, test_data);
   avl_insert(&avl, 2, test_data);
 
-  expect_int(avl.tree[0].key, 3, "3 at root");
-  expect_int(avl.tree[left_index(0)].key, 2, "2 to the left of 3");
+  expect_int(root_node(&avl)->key, 3, "3 at root");
+  expect_int(left_of(&avl, root_node(&avl))->key, 2, "2 to the left of 3");
 
   //this should make tree unbalanced and cause a right rotation
   avl_insert(&avl, 1, test_data);
 
-  expect_int(avl.tree[0].key, 2, "2 at root");
-  expect_int(avl.tree[left_index(0)].key, 1, "1 to the left of 2");
-  expect_int(avl.tree[right_index(0)].key, 3, "3 to the right of 2");
+  expect_int(root_node(&avl)->key, 2, "2 at root");
+  expect_int(left_of(&avl, root_node(&avl))->key, 1, "1 to the left of 2");
+  expect_int(right_of(&avl, root_node(&avl))->key, 3, "3 to the right of 2");
+
+  avl_destroy(&avl);
 }
 
 void test_left_rotate(){
@@ -63,15 +112,17 @@ void test_left_rotate(){
   avl_insert(&avl, 1, test_data);
   avl_insert(&avl, 2, test_data);
 
-  expect_int(avl.tree[0].key, 1, "1 at root");
-  expect_int(avl.tree[right_index(0)].key, 2, "2 to the right of 1");
+  expect_int(root_node(&avl)->key, 1, "1 at root");
+  expect_int(right_of(&avl, root_node(&avl))->key, 2, "2 to the right of 1");
 
   //this should make tree unbalanced and cause a left rotation
   avl_insert(&avl, 3, test_data);
 
-  expect_int(avl.tree[0].key, 2, "2 at root");
-  expect_int(avl.tree[left_index(0)].key, 1, "1 to the left of 2");
-  expect_int(avl.tree[right_index(0)].key, 3, "3 to the right of 2");
+  expect_int(root_node(&avl)->key, 2, "2 at root");
+  expect_int(left_of(&avl, root_node(&avl))->key, 1, "1 to the left of 2");
+  expect_int(right_of(&avl, root_node(&avl))->key, 3, "3 to the right of 2");
+
+  avl_destroy(&avl);
 }
 
 void test_left_right_rotate(){
@@ -81,15 +132,17 @@ void test_left_right_rotate(){
   avl_insert(&avl, 3, test_data);
   avl_insert(&avl, 1, test_data);
 
-  expect_int(avl.tree[0].key, 3, "3 at root");
-  expect_int(avl.tree[left_index(0)].key, 1, "1 to the left of 3");
+  expect_int(root_node(&avl)->key, 3, "3 at root");
+  expect_int(left_of(&avl, root_node(&avl))->key, 1, "1 to the left of 3");
 
   //this should make tree unbalanced and cause a left right rotation
   avl_insert(&avl, 2, test_data);
 
-  expect_int(avl.tree[0].key, 2, "2 at root");
-  expect_int(avl.tree[left_index(0)].key, 1, "1 to the left of 2");
-  expect_int(avl.tree[right_index(0)].key, 3, "3 to the right of 2");
+  expect_int(root_node(&avl)->key, 2, "2 at root");
+  expect_int(left_of(&avl, root_node(&avl))->key, 1, "1 to the left of 2");
+  expect_int(right_of(&avl, root_node(&avl))->key, 3, "3 to the right of 2");
+
+  avl_destroy(&avl);
 }
 
 void test_right_left_rotate(){
@@ -99,15 +152,288 @@ void test_right_left_rotate(){
   avl_insert(&avl, 1, test_data);
   avl_insert(&avl, 3, test_data);
 
-  expect_int(avl.tree[0].key, 1, "1 at root");
-  expect_int(avl.tree[right_index(0)].key, 3, "3 to the right of 1");
+  expect_int(root_node(&avl)->key, 1, "1 at root");
+  expect_int(right_of(&avl, root_node(&avl))->key, 3, "3 to the right of 1");
 
   //this should make tree unbalanced and cause a right left rotation
   avl_insert(&avl, 2, test_data);
 
-  expect_int(avl.tree[0].key, 2, "2 at root");
-  expect_int(avl.tree[left_index(0)].key, 1, "1 to the left of 2");
-  expect_int(avl.tree[right_index(0)].key, 3, "3 to the right of 2");
+  expect_int(root_node(&avl)->key, 2, "2 at root");
+  expect_int(left_of(&avl, root_node(&avl))->key, 1, "1 to the left of 2");
+  expect_int(right_of(&avl, root_node(&avl))->key, 3, "3 to the right of 2");
+
+  avl_destroy(&avl);
+}
+
+void test_data_follows_key(){
+  puts("testing data stays with its key through rotations");
+  struct avl_tree avl = avl_create(10);
+
+  avl_insert(&avl, 3, key_data(3));
+  avl_insert(&avl, 1, key_data(1));
+  avl_insert(&avl, 2, key_data(2));
+
+  expect_int(avl_search(&avl, 1)->colour == &colours[1], 1, "1 has its data");
+  expect_int(avl_search(&avl, 2)->colour == &colours[2], 1, "2 has its data");
+  expect_int(avl_search(&avl, 3)->colour == &colours[3], 1, "3 has its data");
+
+  avl_destroy(&avl);
+}
+
+void test_growth(){
+  puts("testing growth past initial capacity");
+  struct avl_tree avl = avl_create(2);
+
+  bool inserted = true;
+
+  for(unsigned int i = 0; i < 10000; i++){
+    inserted &= avl_insert(&avl, i, key_data(i));
+  }
+
+  expect_int(inserted, 1, "every insert succeeded");
+  expect_uint(avl.size, 10000, "size");
+  expect_int(avl.capacity < 20000, 1, "capacity proportional to size");
+
+  unsigned int found = 0;
+
+  for(unsigned int i = 0; i < 10000; i++){
+    struct tge_data* data = avl_search(&avl, i);
+    found += data != NULL && data->colour == &colours[i];
+  }
+
+  expect_uint(found, 10000, "every key found with its data");
+  //a perfectly balanced tree of 10000 keys has height 13
+  expect_int(root_node(&avl)->height <= 14, 1, "sequential inserts stay balanced");
+
+  avl_destroy(&avl);
+}
+
+//check ordering and AVL balance of every node, return the subtree height
+static int check_subtree(struct avl_tree* avl, unsigned int index, long long low, long long high, bool* valid){
+  if(index == AVL_NIL){
+    return -1;
+  }
+
+  struct avl_node* node = &avl->tree[index];
+
+  if(node->key <= low || node->key >= high){
+    *valid = false;
+  }
+
+  int left = check_subtree(avl, node->left, low, node->key, valid);
+  int right = check_subtree(avl, node->right, node->key, high, valid);
+  int height = (left > right ? left : right) + 1;
+
+  if(node->height != height || left - right > 1 || right - left > 1){
+    *valid = false;
+  }
+
+  return height;
+}
+
+static bool tree_valid(struct avl_tree* avl){
+  bool valid = true;
+  check_subtree(avl, avl->root, -1, (long long)UINT_MAX + 1, &valid);
+  return valid;
+}
+
+void test_create_from(){
+  puts("testing bulk creation");
+  struct avl_entry entries[1000];
+
+  //unsorted, with every key below 100 appearing twice
+  for(unsigned int i = 0; i < 1000; i++){
+    unsigned int key = (i * 7919) % 900;
+    entries[i] = (struct avl_entry){ .key = key, .data = key_data(key) };
+  }
+
+  struct avl_tree avl = avl_create_from(entries, 1000);
+
+  expect_uint(avl.size, 900, "duplicates collapsed");
+  expect_int(tree_valid(&avl), 1, "ordered and balanced");
+
+  unsigned int found = 0;
+
+  for(unsigned int i = 0; i < 900; i++){
+    struct tge_data* data = avl_search(&avl, i);
+    found += data != NULL && data->colour == &colours[i];
+  }
+
+  expect_uint(found, 900, "every key found with its data");
+
+  avl_insert(&avl, 5000, key_data(5000));
+
+  expect_int(avl_search(&avl, 5000) != NULL, 1, "insert after bulk creation");
+  expect_int(tree_valid(&avl), 1, "still ordered and balanced");
+
+  avl_destroy(&avl);
+}
+
+void test_search_batch(){
+  puts("testing batched search");
+  struct avl_tree avl = avl_create(0);
+
+  for(unsigned int i = 0; i < 100; i += 2){
+    avl_insert(&avl, i, key_data(i));
+  }
+
+  unsigned int keys[21];
+  struct tge_data* results[21];
+
+  for(unsigned int i = 0; i < 21; i++){
+    keys[i] = i * 5;
+  }
+
+  avl_search_batch(&avl, keys, 21, results);
+
+  unsigned int correct = 0;
+
+  for(unsigned int i = 0; i < 21; i++){
+    if(keys[i] % 2 == 0 && keys[i] < 100){
+      correct += results[i] != NULL && results[i]->colour == &colours[keys[i]];
+    } else {
+      correct += results[i] == NULL;
+    }
+  }
+
+  expect_uint(correct, 21, "every result matches a single search");
+
+  avl_destroy(&avl);
+}
+
+void test_remove(){
+  puts("testing removal");
+  struct avl_tree avl = avl_create(0);
+
+  for(unsigned int i = 0; i < 1000; i++){
+    avl_insert(&avl, (i * 7919) % 1000, key_data((i * 7919) % 1000));
+  }
+
+  expect_int(avl_remove(&avl, 5000), 0, "removing a missing key fails");
+  expect_int(avl_remove(&avl, 500), 1, "removing a present key succeeds");
+  expect_int(avl_search(&avl, 500) == NULL, 1, "removed key not found");
+
+  bool valid = true;
+
+  //remove every odd key, in an order that hits leaves and inner nodes
+  for(unsigned int i = 0; i < 1000; i++){
+    unsigned int key = (i * 7919) % 1000;
+
+    if(key % 2 == 1){
+      avl_remove(&avl, key);
+      valid &= tree_valid(&avl);
+    }
+  }
+
+  expect_int(valid, 1, "ordered and balanced after every removal");
+  expect_uint(avl.size, 499, "size");
+
+  unsigned int correct = 0;
+
+  for(unsigned int i = 0; i < 1000; i++){
+    struct tge_data* data = avl_search(&avl, i);
+
+    if(i % 2 == 0 && i != 500){
+      correct += data != NULL && data->colour == &colours[i];
+    } else {
+      correct += data == NULL;
+    }
+  }
+
+  expect_uint(correct, 1000, "remaining keys keep their data");
+
+  for(unsigned int i = 0; i < 1000; i += 2){
+    avl_remove(&avl, i);
+  }
+
+  expect_uint(avl.size, 0, "empty after removing everything");
+  expect_uint(avl.root, AVL_NIL, "empty tree has no root");
+  expect_int(avl.capacity <= 16, 1, "memory given back");
+
+  avl_destroy(&avl);
+
+  expect_int(avl.tree == NULL, 1, "destroyed tree owns no memory");
+}
+
+void test_shrink_failure(){
+  puts("testing a failed shrink");
+  struct avl_tree avl = avl_create(0);
+
+  for(unsigned int i = 0; i < 64; i++){
+    avl_insert(&avl, i, key_data(i));
+  }
+
+  //the removal that takes the size to a quarter of the capacity shrinks,
+  //with the second array failing to allocate
+  for(unsigned int i = 0; i < 47; i++){
+    avl_remove(&avl, i);
+  }
+
+  unsigned int capacity = avl.capacity;
+
+  allocations_until_failure = 1;
+  avl_remove(&avl, 47);
+  allocations_until_failure = -1;
+
+  expect_uint(avl.capacity, capacity, "capacity kept when shrinking fails");
+
+  for(unsigned int i = 0; i < 48; i++){
+    avl_insert(&avl, i, key_data(i));
+  }
+
+  expect_int(tree_valid(&avl), 1, "tree valid after refilling");
+  expect_uint(avl.size, 64, "size");
+
+  avl_destroy(&avl);
+}
+
+void test_iteration(){
+  puts("testing iteration and ranges");
+  struct avl_tree avl = avl_create(0);
+
+  for(unsigned int i = 0; i < 100; i++){
+    unsigned int key = (i * 37) % 100 * 3;
+    avl_insert(&avl, key, key_data(key));
+  }
+
+  struct avl_iter iter;
+  unsigned int key;
+  struct tge_data* data;
+  unsigned int count = 0;
+  bool ordered = true;
+
+  avl_iter_begin(&avl, &iter);
+
+  while(avl_iter_next(&iter, &key, &data)){
+    ordered &= key == count * 3 && data->colour == &colours[key];
+    count++;
+  }
+
+  expect_uint(count, 100, "every key visited");
+  expect_int(ordered, 1, "keys visited in order with their data");
+
+  count = 0;
+  ordered = true;
+
+  avl_range_begin(&avl, &iter, 10, 31);
+
+  while(avl_iter_next(&iter, &key, &data)){
+    ordered &= key == 12 + count * 3;
+    count++;
+  }
+
+  //12, 15, 18, 21, 24, 27, 30
+  expect_uint(count, 7, "keys in [10, 31)");
+  expect_int(ordered, 1, "range visited in order");
+
+  avl_range_begin(&avl, &iter, 12, 12);
+  expect_int(avl_iter_next(&iter, &key, &data), 0, "empty range");
+
+  avl_range_begin(&avl, &iter, 297, 1000);
+  expect_int(avl_iter_next(&iter, &key, &data) && key == 297, 1, "range at the end");
+  expect_int(avl_iter_next(&iter, &key, &data), 0, "nothing past the end");
+
+  avl_destroy(&avl);
 }
 
 int main(){
@@ -116,6 +442,13 @@ int main(){
   test_left_rotate();
   test_left_right_rotate();
   test_right_left_rotate();
+  test_data_follows_key();
+  test_growth();
+  test_create_from();
+  test_search_batch();
+  test_remove();
+  test_shrink_failure();
+  test_iteration();
 
   return 0;
 }
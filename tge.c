@@ -1,15 +1,28 @@
+#include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "tge.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TGE_SIMD_X86
+#include <immintrin.h>
+#endif
+
 //TODO handle potential error codes from functions like tcsetattr
 
 static struct termios term_init_flags;
@@ -17,48 +30,723 @@ static struct termios term_cur_flags;
 
 static tge_resize_callback resize_callback;
 
+//the SIGWINCH handler only sets the flag and wakes anything waiting on the
+//pipe. The resize itself happens in tge_process_resize outside signal context
+static atomic_bool resize_pending;
+//set by tge_init_headless. There is no tty to configure or restore
+static bool headless;
+static int resize_pipe[2] = { -1, -1 };
+
 unsigned short tge_rows;
 unsigned short tge_cols;
 
 unsigned short tge_cursor_x;
 unsigned short tge_cursor_y;
 
-static int kbhit(void){
-  int k;
-  ioctl(STDIN_FILENO, FIONREAD, &k);
-  return k;
-}
+//one character cell with its style. padding is always zero so cells can be
+//compared as plain memory. A wide glyph has width 2 and is followed by a
+//continuation cell of width 0 with no codepoint
+struct cell {
+  uint32_t fg;
+  uint32_t bg;
+  uint32_t ch;
+  uint8_t attrs;
+  uint8_t width;
+  uint16_t padding;
+};
+
+static const struct cell blank_cell = { .ch = ' ', .width = 1 };
+
+//front holds what the terminal currently shows, back holds the frame being drawn
+static struct cell* front_buffer;
+static struct cell* back_buffer;
+static unsigned short buffer_rows;
+static unsigned short buffer_cols;
+
+//the SGR state the terminal is in, so only changes need to be sent
+static struct tge_style terminal_style;
+static bool terminal_style_known;
+static enum tge_colour_mode colour_mode = TGE_COLOUR_MODE_256;
+
+static struct tge_capabilities capabilities;
+//nesting depth of tge_begin_frame, and where the output stood right after
+//the opening marker so an empty frame can take it back
+static unsigned int frame_depth;
+static bool frame_synchronized;
+static size_t frame_mark;
+static size_t frame_mark_pending;
+
+//reused between calls so drawing a scene does not allocate once it has grown
+static const struct tge_game_object** scene_order;
+static size_t scene_order_capacity;
+
+//inclusive rectangle of 1 based cells
+struct rect {
+  int left;
+  int top;
+  int right;
+  int bottom;
+};
+
+//an object owned by the registry. Free slots form a list through next_free
+struct registry_slot {
+  struct tge_game_object object;
+  unsigned int generation;
+  unsigned int next_free;
+  bool live;
+};
+
+#define REGISTRY_NIL UINT32_MAX
+//handles are a slot index plus one in the low bits and the slot's
+//generation above, so a handle to a destroyed object stays invalid
+#define HANDLE_INDEX_BITS 20
+#define HANDLE_INDEX_MASK ((1u << HANDLE_INDEX_BITS) - 1)
+//past this many separate damaged areas they collapse into their bounding box
+#define MAX_DAMAGE_RECTS 16
+
+static struct registry_slot* registry;
+static unsigned int registry_capacity;
+static unsigned int registry_free = REGISTRY_NIL;
+static struct registry_slot** registry_order;
+static unsigned int registry_order_count;
+static bool registry_order_dirty;
+static struct rect damage[MAX_DAMAGE_RECTS];
+static unsigned int damage_count;
+
+//registry objects are drawn at their position minus the camera. Vertical
+//camera moves are applied to the screen by scrolling it at the next present
+static int camera_x;
+static int camera_y;
+static int scroll_pending;
+//rows scrolled with the camera, inclusive. 0 means the edge of the screen
+static unsigned short scroll_top;
+static unsigned short scroll_bottom;
+
+//bring the buffers and registry to a new screen size, defined with the registry
+static void screen_resized(void);
+
+//all terminal output is collected here and written with a single write per flush
+static char* output_arena;
+static size_t output_capacity = TGE_DEFAULT_OUTPUT_CAPACITY;
+static size_t output_used;
+static struct tge_output_stats output_stats;
+static int output_fd = STDOUT_FILENO;
+static struct tge_output_backend output_backend;
+static size_t pending_bytes;
+static unsigned int pending_writes;
+
+//bytes read from stdin that have not been decoded yet
+static unsigned char input_buffer[TGE_INPUT_BUFFER_SIZE];
+static unsigned int input_head;
+static unsigned int input_tail;
+static unsigned long long input_stalled_since;
+//stdin reached end of file or hung up, so it is no longer polled
+static bool input_closed;
+static struct tge_key_event key_queue[TGE_KEY_QUEUE_SIZE];
+static unsigned int key_head;
+static unsigned int key_tail;
+
+//set by tge_stop and taken by tge_run, so a stop before the loop starts
+//is not lost
+static atomic_bool stop_requested;
+static struct tge_frame_stats frame_stats;
+//most recent frame times, kept for percentiles
+static unsigned long long frame_times[TGE_FRAME_HISTORY];
+static unsigned int frame_times_next;
 
 static void set_window_size(void){
   struct winsize winsize;
-  ioctl(1, TIOCGWINSZ, &winsize);
+
+  if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &winsize) == -1){
+    return;
+  }
 
   tge_rows = winsize.ws_row;
   tge_cols = winsize.ws_col;
 }
 
 static void handle_terminal_resize(int sig){
-  set_window_size();
+  (void)sig;
 
-  if(resize_callback != NULL){
-    resize_callback(tge_rows, tge_cols);
+  int saved_errno = errno;
+
+  //a storm of signals only needs one wakeup
+  if(!atomic_exchange(&resize_pending, true) && resize_pipe[1] != -1){
+    char byte = 0;
+    ssize_t ignored = write(resize_pipe[1], &byte, 1);
+    (void)ignored;
+  }
+
+  errno = saved_errno;
+}
+
+static void write_all(const char* data, size_t len){
+  if(len == 0){
+    return;
+  }
+
+  if(output_backend.write != NULL){
+    pending_bytes += output_backend.write(output_backend.data, data, len);
+    pending_writes++;
+    return;
+  }
+
+  while(len > 0){
+    ssize_t written = write(output_fd, data, len);
+
+    if(written < 0){
+      if(errno == EINTR){
+        continue;
+      }
+
+      return;
+    }
+
+    pending_bytes += written;
+    pending_writes++;
+
+    data += written;
+    len -= written;
+  }
+}
+
+static void output_spill(void){
+  write_all(output_arena, output_used);
+  output_used = 0;
+}
+
+static void out_write(const char* data, size_t len){
+  if(output_arena == NULL && !tge_set_output_capacity(output_capacity)){
+    write_all(data, len);
+    return;
+  }
+
+  if(len > output_capacity - output_used){
+    output_spill();
+
+    if(len > output_capacity){
+      write_all(data, len);
+      return;
+    }
+  }
+
+  memcpy(&output_arena[output_used], data, len);
+  output_used += len;
+}
+
+#define out_literal(s) out_write(s, sizeof(s) - 1)
+
+static inline void out_char(char c){
+  if(output_arena != NULL && output_used < output_capacity){
+    output_arena[output_used++] = c;
+  } else {
+    out_write(&c, 1);
+  }
+}
+
+static void out_utf8(uint32_t codepoint){
+  char bytes[4];
+
+  if(codepoint < 0x80){
+    out_char(codepoint);
+  } else if(codepoint < 0x800){
+    bytes[0] = 0xC0 | codepoint >> 6;
+    bytes[1] = 0x80 | (codepoint & 0x3F);
+    out_write(bytes, 2);
+  } else if(codepoint < 0x10000){
+    bytes[0] = 0xE0 | codepoint >> 12;
+    bytes[1] = 0x80 | (codepoint >> 6 & 0x3F);
+    bytes[2] = 0x80 | (codepoint & 0x3F);
+    out_write(bytes, 3);
+  } else {
+    bytes[0] = 0xF0 | codepoint >> 18;
+    bytes[1] = 0x80 | (codepoint >> 12 & 0x3F);
+    bytes[2] = 0x80 | (codepoint >> 6 & 0x3F);
+    bytes[3] = 0x80 | (codepoint & 0x3F);
+    out_write(bytes, 4);
+  }
+}
+
+static inline unsigned int utf8_length(uint32_t codepoint){
+  return codepoint < 0x80 ? 1 : codepoint < 0x800 ? 2 : codepoint < 0x10000 ? 3 : 4;
+}
+
+static void out_uint(unsigned int n){
+  char digits[10];
+  unsigned int count = 0;
+
+  do {
+    digits[sizeof(digits) - 1 - count] = '0' + n % 10;
+    n /= 10;
+    count++;
+  } while(n != 0);
+
+  out_write(&digits[sizeof(digits) - count], count);
+}
+
+//ESC [ n final, where n is omitted when it is 1
+static void out_csi(unsigned int n, char final){
+  out_char('\x1B');
+  out_char('[');
+
+  if(n != 1){
+    out_uint(n);
+  }
+
+  out_char(final);
+}
+
+bool tge_set_output_capacity(size_t capacity){
+  if(capacity == 0){
+    return false;
+  }
+
+  if(output_used > 0){
+    output_spill();
+  }
+
+  char* new_arena = realloc(output_arena, capacity);
+
+  if(new_arena == NULL){
+    return false;
+  }
+
+  output_arena = new_arena;
+  output_capacity = capacity;
+
+  return true;
+}
+
+void tge_set_output_fd(int fd){
+  if(output_used > 0){
+    output_spill();
+  }
+
+  output_fd = fd;
+}
+
+void tge_set_output_backend(const struct tge_output_backend* backend){
+  if(output_used > 0){
+    output_spill();
+  }
+
+  output_backend = backend != NULL ? *backend : (struct tge_output_backend){ 0 };
+}
+
+struct tge_output_stats tge_get_output_stats(void){
+  return output_stats;
+}
+
+static inline bool style_is_default(const struct tge_style* style){
+  return style->fg == TGE_COLOUR_DEFAULT && style->bg == TGE_COLOUR_DEFAULT && style->attrs == 0;
+}
+
+static inline bool cell_has_style(const struct cell* cell, const struct tge_style* style){
+  return cell->fg == style->fg && cell->bg == style->bg && cell->attrs == style->attrs;
+}
+
+//xterm's default values for the 16 basic colours
+static const uint8_t basic_colours[16][3] = {
+  { 0, 0, 0 }, { 205, 0, 0 }, { 0, 205, 0 }, { 205, 205, 0 },
+  { 0, 0, 238 }, { 205, 0, 205 }, { 0, 205, 205 }, { 229, 229, 229 },
+  { 127, 127, 127 }, { 255, 0, 0 }, { 0, 255, 0 }, { 255, 255, 0 },
+  { 92, 92, 255 }, { 255, 0, 255 }, { 0, 255, 255 }, { 255, 255, 255 }
+};
+
+static const uint8_t cube_levels[6] = { 0, 95, 135, 175, 215, 255 };
+
+static void indexed_to_rgb(unsigned int index, uint8_t rgb[3]){
+  if(index < 16){
+    memcpy(rgb, basic_colours[index], 3);
+  } else if(index < 232){
+    index -= 16;
+    rgb[0] = cube_levels[index / 36];
+    rgb[1] = cube_levels[index / 6 % 6];
+    rgb[2] = cube_levels[index % 6];
+  } else {
+    rgb[0] = rgb[1] = rgb[2] = 8 + (index - 232) * 10;
+  }
+}
+
+static unsigned int cube_level(uint8_t value){
+  return value < 48 ? 0 : value < 115 ? 1 : (value - 35) / 40;
+}
+
+static unsigned int nearest_basic_colour(const uint8_t rgb[3]){
+  unsigned int best = 0;
+  unsigned int best_distance = UINT32_MAX;
+
+  for(unsigned int i = 0; i < 16; i++){
+    int dr = rgb[0] - basic_colours[i][0];
+    int dg = rgb[1] - basic_colours[i][1];
+    int db = rgb[2] - basic_colours[i][2];
+    unsigned int distance = dr * dr + dg * dg + db * db;
+
+    if(distance < best_distance){
+      best = i;
+      best_distance = distance;
+    }
+  }
+
+  return best;
+}
+
+//reduce a colour to what the current colour mode can show
+static uint32_t colour_for_mode(uint32_t colour){
+  uint32_t kind = colour & TGE_COLOUR_KIND_MASK;
+  uint8_t rgb[3] = { colour >> 16 & 0xFF, colour >> 8 & 0xFF, colour & 0xFF };
+
+  if(kind == TGE_COLOUR_KIND_RGB && colour_mode != TGE_COLOUR_MODE_TRUECOLOR){
+    if(colour_mode == TGE_COLOUR_MODE_16){
+      return TGE_COLOUR_INDEXED(nearest_basic_colour(rgb));
+    }
+
+    return TGE_COLOUR_INDEXED(16 + 36 * cube_level(rgb[0]) + 6 * cube_level(rgb[1]) + cube_level(rgb[2]));
+  }
+
+  if(kind == TGE_COLOUR_KIND_INDEXED && colour_mode == TGE_COLOUR_MODE_16 && (colour & 0xFF) >= 16){
+    indexed_to_rgb(colour & 0xFF, rgb);
+    return TGE_COLOUR_INDEXED(nearest_basic_colour(rgb));
+  }
+
+  return colour;
+}
+
+void tge_set_colour_mode(enum tge_colour_mode mode){
+  colour_mode = mode;
+}
+
+enum tge_colour_mode tge_get_colour_mode(void){
+  return colour_mode;
+}
+
+static size_t format_uint(char* buf, unsigned int n){
+  char digits[10];
+  size_t count = 0;
+
+  do {
+    digits[count++] = '0' + n % 10;
+    n /= 10;
+  } while(n != 0);
+
+  for(size_t i = 0; i < count; i++){
+    buf[i] = digits[count - 1 - i];
+  }
+
+  return count;
+}
+
+static size_t format_param(char* buf, size_t len, unsigned int n){
+  if(len > 2){
+    buf[len++] = ';';
+  }
+
+  return len + format_uint(&buf[len], n);
+}
+
+static size_t format_colour(char* buf, size_t len, uint32_t colour, bool background){
+  uint32_t kind = colour & TGE_COLOUR_KIND_MASK;
+  unsigned int base = background ? 40 : 30;
+
+  if(kind == TGE_COLOUR_KIND_DEFAULT){
+    return format_param(buf, len, base + 9);
+  }
+  if(kind == TGE_COLOUR_KIND_INDEXED && (colour & 0xFF) < 8){
+    return format_param(buf, len, base + (colour & 0xFF));
+  }
+  if(kind == TGE_COLOUR_KIND_INDEXED && (colour & 0xFF) < 16){
+    return format_param(buf, len, base + 60 + (colour & 0xFF) - 8);
+  }
+
+  len = format_param(buf, len, base + 8);
+
+  if(kind == TGE_COLOUR_KIND_INDEXED){
+    len = format_param(buf, len, 5);
+    return format_param(buf, len, colour & 0xFF);
+  }
+
+  len = format_param(buf, len, 2);
+  len = format_param(buf, len, colour >> 16 & 0xFF);
+  len = format_param(buf, len, colour >> 8 & 0xFF);
+  return format_param(buf, len, colour & 0xFF);
+}
+
+//SGR codes that turn each attribute on and off, in TGE_ATTR_* bit order.
+//bold and dim are both turned off by 22
+static const uint8_t attr_on_codes[7] = { 1, 2, 3, 4, 5, 7, 9 };
+static const uint8_t attr_off_codes[7] = { 22, 22, 23, 24, 25, 27, 29 };
+
+//longest SGR sequence: every attribute change plus two truecolor colours
+#define MAX_SGR_LENGTH 96
+
+//write the SGR sequence taking the terminal from one style to another. With
+//from NULL the sequence starts with a reset. Nothing is written when the
+//styles are the same
+static size_t format_style(char* buf, const struct tge_style* from, const struct tge_style* to){
+  struct tge_style current = { 0 };
+  size_t len = 2;
+
+  buf[0] = '\x1B';
+  buf[1] = '[';
+
+  if(from == NULL){
+    len = format_param(buf, len, 0);
+  } else {
+    current = *from;
+
+    uint8_t removed = current.attrs & ~to->attrs;
+
+    for(unsigned int bit = 0; bit < 7; bit++){
+      if(removed & (1 << bit)){
+        len = format_param(buf, len, attr_off_codes[bit]);
+
+        //22 turns off both bold and dim
+        current.attrs &= bit < 2 ? ~(TGE_ATTR_BOLD | TGE_ATTR_DIM) : ~(1 << bit);
+        removed &= bit < 2 ? ~(TGE_ATTR_BOLD | TGE_ATTR_DIM) : ~(1 << bit);
+      }
+    }
+  }
+
+  uint8_t added = to->attrs & ~current.attrs;
+
+  for(unsigned int bit = 0; bit < 7; bit++){
+    if(added & (1 << bit)){
+      len = format_param(buf, len, attr_on_codes[bit]);
+    }
+  }
+
+  if(to->fg != current.fg){
+    len = format_colour(buf, len, to->fg, false);
+  }
+  if(to->bg != current.bg){
+    len = format_colour(buf, len, to->bg, true);
+  }
+
+  //an empty SGR would reset everything rather than change nothing
+  if(len == 2){
+    return 0;
+  }
+
+  buf[len++] = 'm';
+
+  return len;
+}
+
+//bring the terminal to a cell's style, sending the shorter of the change
+//from the current state or a reset followed by the new style
+static void emit_style(const struct cell* cell){
+  struct tge_style style = { .fg = cell->fg, .bg = cell->bg, .attrs = cell->attrs };
+
+  if(terminal_style_known && cell_has_style(cell, &terminal_style)){
+    return;
+  }
+
+  if(style_is_default(&style)){
+    out_literal(TGE_STYLE_RESET);
+  } else {
+    char reset[MAX_SGR_LENGTH];
+    size_t reset_length = format_style(reset, NULL, &style);
+
+    if(terminal_style_known){
+      char delta[MAX_SGR_LENGTH];
+      size_t delta_length = format_style(delta, &terminal_style, &style);
+
+      if(delta_length < reset_length){
+        out_write(delta, delta_length);
+      } else {
+        out_write(reset, reset_length);
+      }
+    } else {
+      out_write(reset, reset_length);
+    }
+  }
+
+  terminal_style = style;
+  terminal_style_known = true;
+}
+
+//parse the parameters of one SGR sequence into style
+static const char* parse_sgr(const char* itr, struct tge_style* style){
+  unsigned int params[16];
+  unsigned int count = 0;
+
+  params[0] = 0;
+
+  for(; *itr != '\0' && *itr != 'm'; itr++){
+    if(*itr >= '0' && *itr <= '9'){
+      params[count] = params[count] * 10 + (*itr - '0');
+    } else if(*itr == ';' && count < 15){
+      params[++count] = 0;
+    } else if(*itr != ';'){
+      return itr;
+    }
+  }
+
+  count++;
+
+  for(unsigned int i = 0; i < count; i++){
+    unsigned int param = params[i];
+
+    if(param == 0){
+      *style = (struct tge_style){ 0 };
+    } else if(param == 38 || param == 48){
+      uint32_t* colour = param == 38 ? &style->fg : &style->bg;
+
+      if(i + 2 < count && params[i + 1] == 5){
+        *colour = TGE_COLOUR_INDEXED(params[i + 2]);
+        i += 2;
+      } else if(i + 4 < count && params[i + 1] == 2){
+        *colour = TGE_COLOUR_RGB(params[i + 2], params[i + 3], params[i + 4]);
+        i += 4;
+      }
+    } else if(param >= 30 && param <= 37){
+      style->fg = TGE_COLOUR_INDEXED(param - 30);
+    } else if(param >= 90 && param <= 97){
+      style->fg = TGE_COLOUR_INDEXED(param - 90 + 8);
+    } else if(param == 39){
+      style->fg = TGE_COLOUR_DEFAULT;
+    } else if(param >= 40 && param <= 47){
+      style->bg = TGE_COLOUR_INDEXED(param - 40);
+    } else if(param >= 100 && param <= 107){
+      style->bg = TGE_COLOUR_INDEXED(param - 100 + 8);
+    } else if(param == 49){
+      style->bg = TGE_COLOUR_DEFAULT;
+    } else {
+      for(unsigned int bit = 0; bit < 7; bit++){
+        if(param == attr_on_codes[bit]){
+          style->attrs |= 1 << bit;
+        } else if(param == attr_off_codes[bit]){
+          style->attrs &= ~(1 << bit);
+        }
+      }
+    }
+  }
+
+  return itr;
+}
+
+struct tge_style tge_style_from_sgr(const char* sgr){
+  struct tge_style style = { 0 };
+
+  while(sgr != NULL && *sgr != '\0'){
+    if(sgr[0] == '\x1B' && sgr[1] == '['){
+      sgr = parse_sgr(sgr + 2, &style);
+    } else {
+      sgr++;
+    }
+  }
+
+  return style;
+}
+
+//(re)allocate both buffers to the current window size. The back buffer keeps
+//whatever overlaps the old size, the front buffer is reset to blank because
+//the terminal content is unknown after a resize and gets cleared below
+static void framebuffer_resize(void){
+  size_t size = (size_t)tge_rows * tge_cols;
+
+  struct cell* new_front = malloc(size * sizeof(struct cell));
+  struct cell* new_back = malloc(size * sizeof(struct cell));
+
+  if(new_front == NULL || new_back == NULL){
+    free(new_front);
+    free(new_back);
+    return;
+  }
+
+  for(size_t i = 0; i < size; i++){
+    new_front[i] = blank_cell;
+    new_back[i] = blank_cell;
+  }
+
+  unsigned short copy_rows = buffer_rows < tge_rows ? buffer_rows : tge_rows;
+  unsigned short copy_cols = buffer_cols < tge_cols ? buffer_cols : tge_cols;
+
+  for(unsigned short y = 0; y < copy_rows; y++){
+    struct cell* row = &new_back[(size_t)y * tge_cols];
+
+    memcpy(row, &back_buffer[(size_t)y * buffer_cols], copy_cols * sizeof(struct cell));
+
+    //a wide glyph cut in half by the new width is dropped
+    if(copy_cols > 0 && row[copy_cols - 1].width == 2){
+      row[copy_cols - 1] = blank_cell;
+    }
+  }
+
+  free(front_buffer);
+  free(back_buffer);
+
+  front_buffer = new_front;
+  back_buffer = new_back;
+  buffer_rows = tge_rows;
+  buffer_cols = tge_cols;
+}
+
+void tge_flush(void){
+  output_spill();
+
+  output_stats.frame_bytes = pending_bytes;
+  output_stats.frame_writes = pending_writes;
+  output_stats.total_bytes += pending_bytes;
+  output_stats.total_writes += pending_writes;
+
+  pending_bytes = 0;
+  pending_writes = 0;
+}
+
+void tge_begin_frame(void){
+  if(frame_depth++ > 0){
+    return;
   }
+
+  frame_synchronized = capabilities.flags & TGE_CAP_SYNCHRONIZED_OUTPUT;
+
+  if(!frame_synchronized){
+    return;
+  }
+
+  out_literal(TGE_SYNC_BEGIN);
+  frame_mark = output_used;
+  frame_mark_pending = pending_bytes;
 }
 
-inline void tge_flush(void){
-  fflush(stdout);
+void tge_end_frame(void){
+  if(frame_depth == 0 || --frame_depth > 0 || !frame_synchronized){
+    return;
+  }
+
+  //nothing was output since the opening marker, so drop it
+  if(output_used == frame_mark && pending_bytes == frame_mark_pending && output_used >= sizeof(TGE_SYNC_BEGIN) - 1){
+    output_used -= sizeof(TGE_SYNC_BEGIN) - 1;
+    return;
+  }
+
+  out_literal(TGE_SYNC_END);
 }
 
-inline void tge_clear(void){
-  fputs(TGE_CLEAR, stdout);
+void tge_clear(void){
+  //the screen is cleared to the current background colour
+  if(!terminal_style_known || !style_is_default(&terminal_style)){
+    out_literal(TGE_STYLE_RESET);
+    terminal_style = (struct tge_style){ 0 };
+    terminal_style_known = true;
+  }
+
+  out_literal(TGE_CLEAR);
+
+  size_t size = (size_t)buffer_rows * buffer_cols;
+
+  for(size_t i = 0; i < size && front_buffer != NULL; i++){
+    front_buffer[i] = blank_cell;
+  }
 }
 
-inline void tge_cursor_off(void){
-  fputs(TGE_CURSOR_OFF, stdout);
+void tge_cursor_off(void){
+  out_literal(TGE_CURSOR_OFF);
 }
 
-inline void tge_cursor_on(void){
-  fputs(TGE_CURSOR_ON, stdout);
+void tge_cursor_on(void){
+  out_literal(TGE_CURSOR_ON);
 }
 
 void tge_echo_off(void){
@@ -87,24 +775,30 @@ void tge_raw_mode(void){
   tcsetattr(STDIN_FILENO, TCSANOW, &term_cur_flags);
 }
 
-inline void tge_cursor_move_reset(void){
-  fputs(TGE_CURSOR_HOME, stdout);
+void tge_cursor_move_reset(void){
+  out_literal(TGE_CURSOR_HOME);
+  tge_cursor_x = 1;
+  tge_cursor_y = 1;
 }
 
 void tge_cursor_move_xy(int x, int y){
-  printf("\x1B[%d;%dH", y, x);
+  out_literal("\x1B[");
+  out_uint(y);
+  out_char(';');
+  out_uint(x);
+  out_char('H');
   tge_cursor_x = x;
   tge_cursor_y = y;
 }
 
 bool tge_cursor_move_left(unsigned short n){
-  if(n >= tge_cursor_x + 1){
+  if(n >= tge_cursor_x){
     return false;
   }
 
   unsigned short new_x = tge_cursor_x - n;
 
-  printf("\x1B[%huD", n);
+  out_csi(n, 'D');
   tge_cursor_x = new_x;
 
   return true;
@@ -113,24 +807,24 @@ bool tge_cursor_move_left(unsigned short n){
 bool tge_cursor_move_right(unsigned short n){
   unsigned short new_x = tge_cursor_x + n;
 
-  if(new_x >= tge_cols){
+  if(new_x > tge_cols){
     return false;
   }
 
-  printf("\x1B[%huC", n);
+  out_csi(n, 'C');
   tge_cursor_x = new_x;
 
   return true;
 }
 
 bool tge_cursor_move_up(unsigned short n){
-  if(n >= tge_cursor_y + 1){
+  if(n >= tge_cursor_y){
     return false;
   }
 
   unsigned short new_y = tge_cursor_y - n;
 
-  printf("\x1B[%huA", n);
+  out_csi(n, 'A');
   tge_cursor_y = new_y;
 
   return true;
@@ -139,11 +833,11 @@ bool tge_cursor_move_up(unsigned short n){
 bool tge_cursor_move_down(unsigned short n){
   unsigned short new_y = tge_cursor_y + n;
 
-  if(new_y >= tge_rows){
+  if(new_y > tge_rows){
     return false;
   }
 
-  printf("\x1B[%huB", n);
+  out_csi(n, 'B');
   tge_cursor_y = new_y;
 
   return true;
@@ -155,9 +849,13 @@ void tge_init_term_flags(void){
 }
 
 void tge_init(void){
+  input_closed = false;
+
   tge_init_term_flags();
   tge_raw_mode();
 
+  tge_probe_capabilities(TGE_PROBE_TIMEOUT_MS);
+
   tge_cursor_off();
   tge_clear();
   tge_cursor_move_reset();
@@ -165,189 +863,2264 @@ void tge_init(void){
   tge_flush();
 
   set_window_size();
+  framebuffer_resize();
+
+  if(resize_pipe[0] == -1 && pipe(resize_pipe) == 0){
+    for(int i = 0; i < 2; i++){
+      fcntl(resize_pipe[i], F_SETFL, fcntl(resize_pipe[i], F_GETFL) | O_NONBLOCK);
+      fcntl(resize_pipe[i], F_SETFD, FD_CLOEXEC);
+    }
+  }
 
   struct sigaction sigact;
+  sigemptyset(&sigact.sa_mask);
+  sigact.sa_flags = SA_RESTART;
   sigact.sa_handler = &handle_terminal_resize;
   sigaction(SIGWINCH, &sigact, NULL);
 }
 
+void tge_init_headless(unsigned short rows, unsigned short cols){
+  headless = true;
+  tge_rows = rows;
+  tge_cols = cols;
+
+  tge_cursor_off();
+  tge_clear();
+  tge_cursor_move_reset();
+
+  tge_flush();
+
+  framebuffer_resize();
+}
+
 void tge_clean(void){
-  tcsetattr(1, TCSANOW, &term_init_flags);
+  if(!headless){
+    signal(SIGWINCH, SIG_DFL);
+    tcsetattr(1, TCSANOW, &term_init_flags);
+  }
+
+  if(resize_pipe[0] != -1){
+    close(resize_pipe[0]);
+    close(resize_pipe[1]);
+    resize_pipe[0] = -1;
+    resize_pipe[1] = -1;
+  }
+
+  out_literal(TGE_STYLE_RESET);
+  terminal_style_known = false;
   tge_cursor_on();
   tge_flush();
+
+  headless = false;
+  input_closed = false;
+
+  free(front_buffer);
+  free(back_buffer);
+  free(scene_order);
+  free(registry);
+  free(registry_order);
+  front_buffer = NULL;
+  back_buffer = NULL;
+  scene_order = NULL;
+  scene_order_capacity = 0;
+  registry = NULL;
+  registry_capacity = 0;
+  registry_free = REGISTRY_NIL;
+  registry_order = NULL;
+  registry_order_count = 0;
+  damage_count = 0;
+  camera_x = 0;
+  camera_y = 0;
+  scroll_pending = 0;
+  scroll_top = 0;
+  scroll_bottom = 0;
+  buffer_rows = 0;
+  buffer_cols = 0;
+  capabilities = (struct tge_capabilities){ 0 };
+  frame_depth = 0;
 }
 
 void tge_set_resize_callback(tge_resize_callback callback){
   resize_callback = callback;
 }
 
-int tge_get_key(void){
-  if(kbhit()){
-    char c;
-    read(STDIN_FILENO, &c, 1);
-
-    switch(c){
-      case 'a':
-      case 'A':
-        return TGE_KEY_A;
-      case 'b':
-      case 'B':
-        return TGE_KEY_B;
-      case 'c':
-      case 'C':
-        return TGE_KEY_C;
-      case 'd':
-      case 'D':
-        return TGE_KEY_D;
-      case 'e':
-      case 'E':
-        return TGE_KEY_E;
-      case 'f':
-      case 'F':
-        return TGE_KEY_F;
-      case 'g':
-      case 'G':
-        return TGE_KEY_G;
-      case 'h':
-      case 'H':
-        return TGE_KEY_H;
-      case 'i':
-      case 'I':
-        return TGE_KEY_I;
-      case 'j':
-      case 'J':
-        return TGE_KEY_J;
-      case 'k':
-      case 'K':
-        return TGE_KEY_K;
-      case 'l':
-      case 'L':
-        return TGE_KEY_L;
-      case 'm':
-      case 'M':
-        return TGE_KEY_M;
-      case 'n':
-      case 'N':
-        return TGE_KEY_N;
-      case 'o':
-      case 'O':
-        return TGE_KEY_O;
-      case 'p':
-      case 'P':
-        return TGE_KEY_P;
-      case 'q':
-      case 'Q':
-        return TGE_KEY_Q;
-      case 'r':
-      case 'R':
-        return TGE_KEY_R;
-      case 's':
-      case 'S':
-        return TGE_KEY_S;
-      case 't':
-      case 'T':
-        return TGE_KEY_T;
-      case 'u':
-      case 'U':
-        return TGE_KEY_U;
-      case 'v':
-      case 'V':
-        return TGE_KEY_V;
-      case 'w':
-      case 'W':
-        return TGE_KEY_W;
-      case 'x':
-      case 'X':
-        return TGE_KEY_X;
-      case 'y':
-      case 'Y':
-        return TGE_KEY_Y;
-      case 'z':
-      case 'Z':
-        return TGE_KEY_Z;
-      case ' ':
-        return TGE_KEY_SPACE;
-      case '\x1B': {
-        char esc[3];
-        ssize_t bytes_read = read(STDIN_FILENO, esc, 3);
-
-        switch(bytes_read){
-          case 0:
-            return TGE_KEY_ESC;
-          case 2:
-            if(esc[0] == '['){
-              switch(esc[1]){
-                case 'A': return TGE_KEY_UP;
-                case 'B': return TGE_KEY_DOWN;
-                case 'C': return TGE_KEY_RIGHT;
-                case 'D': return TGE_KEY_LEFT;
-              }
-            }
-        }
-      }
-    }
+bool tge_process_resize(void){
+  if(!atomic_load(&resize_pending)){
+    return false;
   }
 
-  return TGE_KEY_NONE;
-}
+  //drain before taking the flag. A signal after the drain then either
+  //finds the flag still set and is handled here, as the size is read
+  //below, or sets it again and writes a new wakeup
+  if(resize_pipe[0] != -1){
+    char drain[16];
+    while(read(resize_pipe[0], drain, sizeof(drain)) > 0);
+  }
 
-static bool cursor_move_valid(int x, int y){
-  if(x >= tge_cols || y >= tge_rows){
+  if(!atomic_exchange(&resize_pending, false)){
     return false;
   }
-  if(x <= 0 || y <= 0){
+
+  unsigned short old_rows = tge_rows;
+  unsigned short old_cols = tge_cols;
+
+  set_window_size();
+
+  if(tge_rows == old_rows && tge_cols == old_cols){
     return false;
   }
 
+  screen_resized();
+
+  if(resize_callback != NULL){
+    resize_callback(tge_rows, tge_cols);
+  }
+
   return true;
 }
 
-void tge_draw_game_object(struct tge_game_object game_object){
-  char* itr = game_object.text;
+#define NANOSECONDS_PER_SECOND 1000000000ULL
 
-  int cur_x = game_object.pos.x;
-  int cur_y = game_object.pos.y;
+static unsigned long long monotonic_ns(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
 
-  //TODO: maybe pass in string struct that specifies length
-  while(*itr != '\0'){
-    tge_cursor_move_xy(cur_x, cur_y);
+  return (unsigned long long)now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
 
-    if(cursor_move_valid(cur_x, cur_y)){
-      putchar(*itr);
-    }
+//input decoding is table driven: single bytes, CSI and SS3 final bytes and
+//the numbered CSI ~ sequences each have a lookup table
+
+struct key_mapping {
+  bool mapped;
+  signed char key;
+  unsigned char mods;
+};
+
+#define MAP(key, mods) { true, key, mods }
+
+#define LETTER(lower, key) \
+  [lower] = MAP(key, 0), \
+  [lower - 'a' + 'A'] = MAP(key, TGE_MOD_SHIFT), \
+  [lower - 'a' + 1] = MAP(key, TGE_MOD_CTRL)
+
+//ctrl h, i, j and m share their bytes with backspace, tab and enter
+#define LETTER_NO_CTRL(lower, key) \
+  [lower] = MAP(key, 0), \
+  [lower - 'a' + 'A'] = MAP(key, TGE_MOD_SHIFT)
+
+static const struct key_mapping byte_keys[128] = {
+  LETTER('a', TGE_KEY_A), LETTER('b', TGE_KEY_B), LETTER('c', TGE_KEY_C),
+  LETTER('d', TGE_KEY_D), LETTER('e', TGE_KEY_E), LETTER('f', TGE_KEY_F),
+  LETTER('g', TGE_KEY_G), LETTER_NO_CTRL('h', TGE_KEY_H), LETTER_NO_CTRL('i', TGE_KEY_I),
+  LETTER_NO_CTRL('j', TGE_KEY_J), LETTER('k', TGE_KEY_K), LETTER('l', TGE_KEY_L),
+  LETTER_NO_CTRL('m', TGE_KEY_M), LETTER('n', TGE_KEY_N), LETTER('o', TGE_KEY_O),
+  LETTER('p', TGE_KEY_P), LETTER('q', TGE_KEY_Q), LETTER('r', TGE_KEY_R),
+  LETTER('s', TGE_KEY_S), LETTER('t', TGE_KEY_T), LETTER('u', TGE_KEY_U),
+  LETTER('v', TGE_KEY_V), LETTER('w', TGE_KEY_W), LETTER('x', TGE_KEY_X),
+  LETTER('y', TGE_KEY_Y), LETTER('z', TGE_KEY_Z),
+  ['0'] = MAP(TGE_KEY_0, 0), ['1'] = MAP(TGE_KEY_1, 0), ['2'] = MAP(TGE_KEY_2, 0),
+  ['3'] = MAP(TGE_KEY_3, 0), ['4'] = MAP(TGE_KEY_4, 0), ['5'] = MAP(TGE_KEY_5, 0),
+  ['6'] = MAP(TGE_KEY_6, 0), ['7'] = MAP(TGE_KEY_7, 0), ['8'] = MAP(TGE_KEY_8, 0),
+  ['9'] = MAP(TGE_KEY_9, 0),
+  [' '] = MAP(TGE_KEY_SPACE, 0),
+  ['\r'] = MAP(TGE_KEY_ENTER, 0),
+  ['\n'] = MAP(TGE_KEY_ENTER, 0),
+  ['\t'] = MAP(TGE_KEY_TAB, 0),
+  ['\b'] = MAP(TGE_KEY_BACKSPACE, 0),
+  [0x7F] = MAP(TGE_KEY_BACKSPACE, 0),
+  ['\x1B'] = MAP(TGE_KEY_ESC, 0)
+};
+
+//ESC [ <params> final, e.g. ESC [ A or ESC [ 1 ; 5 A for ctrl up
+static const struct key_mapping csi_keys[128] = {
+  ['A'] = MAP(TGE_KEY_UP, 0),
+  ['B'] = MAP(TGE_KEY_DOWN, 0),
+  ['C'] = MAP(TGE_KEY_RIGHT, 0),
+  ['D'] = MAP(TGE_KEY_LEFT, 0),
+  ['H'] = MAP(TGE_KEY_HOME, 0),
+  ['F'] = MAP(TGE_KEY_END, 0),
+  ['P'] = MAP(TGE_KEY_F1, 0),
+  ['Q'] = MAP(TGE_KEY_F2, 0),
+  ['R'] = MAP(TGE_KEY_F3, 0),
+  ['S'] = MAP(TGE_KEY_F4, 0),
+  ['Z'] = MAP(TGE_KEY_TAB, TGE_MOD_SHIFT)
+};
+
+//ESC O final, sent by terminals in application cursor mode and for F1-F4
+static const struct key_mapping ss3_keys[128] = {
+  ['A'] = MAP(TGE_KEY_UP, 0),
+  ['B'] = MAP(TGE_KEY_DOWN, 0),
+  ['C'] = MAP(TGE_KEY_RIGHT, 0),
+  ['D'] = MAP(TGE_KEY_LEFT, 0),
+  ['H'] = MAP(TGE_KEY_HOME, 0),
+  ['F'] = MAP(TGE_KEY_END, 0),
+  ['M'] = MAP(TGE_KEY_ENTER, 0),
+  ['P'] = MAP(TGE_KEY_F1, 0),
+  ['Q'] = MAP(TGE_KEY_F2, 0),
+  ['R'] = MAP(TGE_KEY_F3, 0),
+  ['S'] = MAP(TGE_KEY_F4, 0)
+};
+
+//ESC [ n ~ and ESC [ n ; m ~, indexed by n
+static const struct key_mapping tilde_keys[] = {
+  [1] = MAP(TGE_KEY_HOME, 0),
+  [2] = MAP(TGE_KEY_INSERT, 0),
+  [3] = MAP(TGE_KEY_DELETE, 0),
+  [4] = MAP(TGE_KEY_END, 0),
+  [5] = MAP(TGE_KEY_PAGE_UP, 0),
+  [6] = MAP(TGE_KEY_PAGE_DOWN, 0),
+  [7] = MAP(TGE_KEY_HOME, 0),
+  [8] = MAP(TGE_KEY_END, 0),
+  [11] = MAP(TGE_KEY_F1, 0),
+  [12] = MAP(TGE_KEY_F2, 0),
+  [13] = MAP(TGE_KEY_F3, 0),
+  [14] = MAP(TGE_KEY_F4, 0),
+  [15] = MAP(TGE_KEY_F5, 0),
+  [17] = MAP(TGE_KEY_F6, 0),
+  [18] = MAP(TGE_KEY_F7, 0),
+  [19] = MAP(TGE_KEY_F8, 0),
+  [20] = MAP(TGE_KEY_F9, 0),
+  [21] = MAP(TGE_KEY_F10, 0),
+  [23] = MAP(TGE_KEY_F11, 0),
+  [24] = MAP(TGE_KEY_F12, 0)
+};
+
+#define TILDE_KEY_COUNT (sizeof(tilde_keys) / sizeof(tilde_keys[0]))
+
+//longest escape sequence accepted before giving up on it
+#define MAX_SEQUENCE_LENGTH 32
+
+static inline unsigned char input_byte(unsigned int i){
+  return input_buffer[(input_head + i) & (TGE_INPUT_BUFFER_SIZE - 1)];
+}
 
-    if(*itr == '\n'){
-      cur_x = game_object.pos.x;
-      cur_y++;
+static void queue_key(struct tge_key_event event){
+  if(event.key == TGE_KEY_NONE || key_tail - key_head == TGE_KEY_QUEUE_SIZE){
+    return;
+  }
+
+  key_queue[key_tail & (TGE_KEY_QUEUE_SIZE - 1)] = event;
+  key_tail++;
+}
+
+static struct tge_key_event mapped_event(struct key_mapping mapping, unsigned int mods){
+  struct tge_key_event event = { .key = TGE_KEY_NONE };
+
+  if(mapping.mapped){
+    event.key = mapping.key;
+    event.mods = mapping.mods | mods;
+  }
+
+  return event;
+}
+
+//xterm style modifier parameter: 1 + (shift 1, alt 2, ctrl 4)
+static unsigned int modifier_param(unsigned int param){
+  return param > 1 ? (param - 1) & (TGE_MOD_SHIFT | TGE_MOD_ALT | TGE_MOD_CTRL) : 0;
+}
+
+//decode a plain byte or UTF-8 character at offset. Return the bytes used,
+//or 0 if the buffer ends before the character does
+static unsigned int decode_char(unsigned int offset, unsigned int count, struct tge_key_event* event){
+  unsigned char c = input_byte(offset);
+
+  *event = (struct tge_key_event){ .key = TGE_KEY_NONE };
+
+  if(c < 0x80){
+    if(byte_keys[c].mapped){
+      *event = mapped_event(byte_keys[c], 0);
+    } else if(c >= ' '){
+      event->key = TGE_KEY_CHAR;
+    }
+
+    if(c >= ' ' && c < 0x7F){
+      event->codepoint = c;
+    }
+
+    return 1;
+  }
+
+  unsigned int length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+
+  //stray continuation byte or invalid lead, skip it
+  if(length == 1 || c >= 0xF8){
+    return 1;
+  }
+  if(count - offset < length){
+    return 0;
+  }
+
+  unsigned int codepoint = c & (0x7F >> length);
+
+  for(unsigned int i = 1; i < length; i++){
+    unsigned char next = input_byte(offset + i);
+
+    if((next & 0xC0) != 0x80){
+      return i;
+    }
+
+    codepoint = (codepoint << 6) | (next & 0x3F);
+  }
+
+  event->key = TGE_KEY_CHAR;
+  event->codepoint = codepoint;
+
+  return length;
+}
+
+//decode an escape sequence starting with the ESC at offset 0. Return the bytes
+//used, or 0 if the buffer ends before the sequence does
+static unsigned int decode_escape(unsigned int count, struct tge_key_event* event){
+  *event = (struct tge_key_event){ .key = TGE_KEY_NONE };
+
+  if(count == 1){
+    return 0;
+  }
+
+  unsigned char introducer = input_byte(1);
+
+  //ESC followed by anything else is that key with alt held
+  if(introducer != '[' && introducer != 'O'){
+    if(introducer == '\x1B'){
+      event->key = TGE_KEY_ESC;
+      return 1;
+    }
+
+    unsigned int used = decode_char(1, count, event);
+
+    if(used == 0){
+      return 0;
+    }
+
+    event->mods |= TGE_MOD_ALT;
+
+    return used + 1;
+  }
+
+  unsigned int params[2] = { 0, 0 };
+  unsigned int param_count = 0;
+  bool private_params = false;
+  unsigned int i = 2;
+
+  //parameter bytes 0x30-0x3F and intermediate bytes 0x20-0x2F run up to the
+  //final byte 0x40-0x7E
+  for(; i < count && i < MAX_SEQUENCE_LENGTH; i++){
+    unsigned char c = input_byte(i);
+
+    if(c >= '0' && c <= '9'){
+      if(param_count < 2 && params[param_count] < 1000){
+        params[param_count] = params[param_count] * 10 + (c - '0');
+      }
+    } else if(c == ';'){
+      param_count++;
+    } else if(c >= 0x20 && c <= 0x3F){
+      private_params = true;
+    } else {
+      break;
+    }
+  }
+
+  if(i == MAX_SEQUENCE_LENGTH){
+    return i;
+  }
+  if(i == count){
+    return 0;
+  }
+
+  unsigned char final = input_byte(i);
+
+  if(final < 0x40 || final > 0x7E || private_params){
+    return i + 1;
+  }
+
+  if(introducer == 'O'){
+    //some terminals send the modifier as ESC O 5 A
+    *event = mapped_event(ss3_keys[final], modifier_param(params[0]));
+  } else if(final == '~'){
+    if(params[0] < TILDE_KEY_COUNT){
+      *event = mapped_event(tilde_keys[params[0]], modifier_param(params[1]));
+    }
+  } else {
+    *event = mapped_event(csi_keys[final], modifier_param(params[1]));
+  }
+
+  return i + 1;
+}
+
+//turn buffered bytes into key events. A sequence cut off by the end of the
+//buffer is left for the next read, unless force is set, in which case its
+//bytes are taken literally
+static void input_parse(bool force){
+  while(input_tail != input_head){
+    unsigned int count = input_tail - input_head;
+    struct tge_key_event event;
+    unsigned int used;
+
+    if(input_byte(0) == '\x1B'){
+      used = decode_escape(count, &event);
+    } else {
+      used = decode_char(0, count, &event);
+    }
+
+    if(used == 0 && !force){
+      if(input_stalled_since == 0){
+        input_stalled_since = monotonic_ns();
+      }
+
+      return;
+    }
+
+    if(used == 0){
+      event = (struct tge_key_event){ .key = input_byte(0) == '\x1B' ? TGE_KEY_ESC : TGE_KEY_NONE };
+      used = 1;
+    }
+
+    queue_key(event);
+    input_head += used;
+  }
+
+  input_stalled_since = 0;
+}
+
+//milliseconds until a sequence cut off at the end of the buffer is taken literally
+static int stalled_input_timeout(void){
+  unsigned long long waited = monotonic_ns() - input_stalled_since;
+  unsigned long long timeout = TGE_ESCAPE_TIMEOUT_MS * 1000000ULL;
+
+  return waited >= timeout ? 0 : (timeout - waited + 999999) / 1000000;
+}
+
+//read everything pending on stdin with one syscall, splitting the read in
+//two when the free space wraps around the end of the ring
+static void input_read(void){
+  unsigned int used = input_tail - input_head;
+  unsigned int space = TGE_INPUT_BUFFER_SIZE - used;
+
+  if(space == 0){
+    return;
+  }
+
+  unsigned int start = input_tail & (TGE_INPUT_BUFFER_SIZE - 1);
+  unsigned int first = TGE_INPUT_BUFFER_SIZE - start;
+
+  struct iovec iov[2] = {
+    { .iov_base = &input_buffer[start], .iov_len = first < space ? first : space },
+    { .iov_base = input_buffer, .iov_len = first < space ? space - first : 0 }
+  };
+
+  ssize_t bytes_read = readv(STDIN_FILENO, iov, iov[1].iov_len > 0 ? 2 : 1);
+
+  if(bytes_read > 0){
+    input_tail += bytes_read;
+    input_parse(false);
+  } else if(bytes_read == 0 || (errno != EINTR && errno != EAGAIN)){
+    input_closed = true;
+  }
+}
+
+//stdin is not read when running headless or once it is closed
+static bool input_open(void){
+  return !headless && !input_closed;
+}
+
+bool tge_wait_input(int timeout_ms){
+  //never wait past the point a cut off sequence is given up on
+  if(input_stalled_since != 0){
+    int remaining = stalled_input_timeout();
+
+    if(timeout_ms < 0 || remaining < timeout_ms){
+      timeout_ms = remaining;
+    }
+  }
+
+  //a resize also ends the wait so it is handled promptly. poll skips
+  //negative descriptors, so with neither it only waits
+  struct pollfd fds[2] = {
+    { .fd = input_open() ? STDIN_FILENO : -1, .events = POLLIN },
+    { .fd = resize_pipe[0], .events = POLLIN }
+  };
+
+  if(poll(fds, 2, timeout_ms) > 0){
+    if(fds[0].revents & POLLNVAL){
+      input_closed = true;
+    } else if(fds[0].revents & (POLLIN | POLLHUP | POLLERR)){
+      //a hang up is confirmed by a read of 0 bytes, after any data left
+      input_read();
+    }
+  }
+
+  tge_process_resize();
+
+  if(input_stalled_since != 0 && stalled_input_timeout() == 0){
+    input_parse(true);
+  }
+
+  return key_head != key_tail;
+}
+
+static bool dequeue_key(struct tge_key_event* event){
+  if(key_head == key_tail){
+    return false;
+  }
+
+  *event = key_queue[key_head & (TGE_KEY_QUEUE_SIZE - 1)];
+  key_head++;
+
+  return true;
+}
+
+bool tge_get_key_event(struct tge_key_event* event){
+  if(key_head == key_tail){
+    tge_wait_input(0);
+  }
+
+  return dequeue_key(event);
+}
+
+int tge_get_key(void){
+  struct tge_key_event event;
+
+  if(!tge_get_key_event(&event)){
+    return TGE_KEY_NONE;
+  }
+
+  return event.key;
+}
+
+//capability probe: queries are answered in the order sent, and every
+//terminal answers DA1, so its reply marks the end of the answers
+
+#define PROBE_QUERIES "\x1B[>0q\x1B[>c\x1B[?2026$p\x1B[c"
+#define PROBE_BUFFER_SIZE 512
+
+enum probe_reply {
+  REPLY_INCOMPLETE,
+  REPLY_NONE,
+  REPLY_DA1,
+  REPLY_DA2,
+  REPLY_MODE,
+  REPLY_VERSION
+};
+
+struct probe_result {
+  unsigned int params[8];
+  unsigned int param_count;
+  //XTVERSION text, within the buffer
+  const char* text;
+  unsigned int text_length;
+};
+
+//recognise a reply at the start of bytes. Return what it is and the bytes it
+//takes in used, REPLY_NONE if it is not a reply, or REPLY_INCOMPLETE if it
+//may be one that has not fully arrived
+static enum probe_reply parse_reply(const char* bytes, unsigned int length, unsigned int* used, struct probe_result* result){
+  *result = (struct probe_result){ 0 };
+
+  if(length < 2){
+    return REPLY_INCOMPLETE;
+  }
+
+  //XTVERSION: DCS > | text ST
+  if(bytes[1] == 'P'){
+    if(length < 4){
+      return REPLY_INCOMPLETE;
+    }
+    if(bytes[2] != '>' || bytes[3] != '|'){
+      return REPLY_NONE;
+    }
+
+    for(unsigned int i = 4; i + 1 < length; i++){
+      if(bytes[i] == '\x1B' && bytes[i + 1] == '\\'){
+        result->text = &bytes[4];
+        result->text_length = i - 4;
+        *used = i + 2;
+        return REPLY_VERSION;
+      }
+    }
+
+    return length < PROBE_BUFFER_SIZE ? REPLY_INCOMPLETE : REPLY_NONE;
+  }
+
+  if(bytes[1] != '['){
+    return REPLY_NONE;
+  }
+  if(length < 3){
+    return REPLY_INCOMPLETE;
+  }
+
+  char prefix = bytes[2];
+
+  if(prefix != '?' && prefix != '>'){
+    return REPLY_NONE;
+  }
+
+  result->param_count = 1;
+
+  for(unsigned int i = 3; i < length; i++){
+    char c = bytes[i];
+
+    if(c >= '0' && c <= '9'){
+      unsigned int* param = &result->params[result->param_count - 1];
+      *param = *param * 10 + (c - '0');
+    } else if(c == ';'){
+      if(result->param_count < sizeof(result->params) / sizeof(result->params[0])){
+        result->params[result->param_count++] = 0;
+      }
+    } else if(c == 'c'){
+      *used = i + 1;
+      return prefix == '?' ? REPLY_DA1 : REPLY_DA2;
+    } else if(c == '$' && prefix == '?'){
+      if(i + 1 == length){
+        return REPLY_INCOMPLETE;
+      }
+      if(bytes[i + 1] != 'y'){
+        return REPLY_NONE;
+      }
+
+      *used = i + 2;
+      return REPLY_MODE;
+    } else {
+      return REPLY_NONE;
+    }
+  }
+
+  return REPLY_INCOMPLETE;
+}
+
+//keep bytes that are not replies, such as keys pressed during the probe
+static void probe_keep_input(const char* bytes, unsigned int length){
+  for(unsigned int i = 0; i < length && input_tail - input_head < TGE_INPUT_BUFFER_SIZE; i++){
+    input_buffer[input_tail++ & (TGE_INPUT_BUFFER_SIZE - 1)] = bytes[i];
+  }
+}
+
+static void probe_handle(enum probe_reply reply, const struct probe_result* result){
+  switch(reply){
+    case REPLY_DA1:
+      //the first parameter is the conformance level. ECH is part of VT220,
+      //level 62, so it is taken from that. Nothing reports REP, so it is
+      //never turned on here
+      capabilities.da1_class = result->params[0];
+
+      if(result->params[0] >= 62){
+        capabilities.flags |= TGE_CAP_ECH;
+      }
+      break;
+    case REPLY_DA2:
+      capabilities.da2_type = result->params[0];
+      capabilities.da2_version = result->param_count > 1 ? result->params[1] : 0;
+      break;
+    case REPLY_MODE:
+      //1 set, 2 reset, 3 permanently set. 0 and 4 mean it cannot be used
+      if(result->params[0] == 2026 && result->param_count > 1 && result->params[1] >= 1 && result->params[1] <= 3){
+        capabilities.flags |= TGE_CAP_SYNCHRONIZED_OUTPUT;
+      }
+      break;
+    case REPLY_VERSION: {
+      unsigned int length = result->text_length < sizeof(capabilities.version) - 1 ? result->text_length : sizeof(capabilities.version) - 1;
+
+      memcpy(capabilities.version, result->text, length);
+      capabilities.version[length] = '\0';
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+unsigned int tge_probe_capabilities(int timeout_ms){
+  capabilities = (struct tge_capabilities){ 0 };
+
+  const char* colorterm = getenv("COLORTERM");
+
+  if(colorterm != NULL && (strcmp(colorterm, "truecolor") == 0 || strcmp(colorterm, "24bit") == 0)){
+    capabilities.flags |= TGE_CAP_TRUECOLOR;
+  }
+
+  if(!headless && output_backend.write == NULL && isatty(STDIN_FILENO) && isatty(output_fd)){
+    out_literal(PROBE_QUERIES);
+    tge_flush();
+
+    char buffer[PROBE_BUFFER_SIZE];
+    unsigned int length = 0;
+    bool answered = false;
+    unsigned long long deadline = monotonic_ns() + (unsigned long long)timeout_ms * 1000000;
+
+    while(!answered){
+      unsigned long long now = monotonic_ns();
+
+      if(now >= deadline){
+        break;
+      }
+
+      struct pollfd fd = { .fd = STDIN_FILENO, .events = POLLIN };
+      int wait_ms = (deadline - now + 999999) / 1000000;
+
+      if(poll(&fd, 1, wait_ms) <= 0){
+        continue;
+      }
+      if(!(fd.revents & POLLIN)){
+        input_closed = true;
+        break;
+      }
+
+      ssize_t bytes_read = read(STDIN_FILENO, &buffer[length], sizeof(buffer) - length);
+
+      if(bytes_read <= 0){
+        input_closed = bytes_read == 0;
+        break;
+      }
+
+      length += bytes_read;
+
+      unsigned int i = 0;
+
+      while(i < length && !answered){
+        struct probe_result result;
+        unsigned int used = 1;
+        enum probe_reply reply = buffer[i] == '\x1B' ? parse_reply(&buffer[i], length - i, &used, &result) : REPLY_NONE;
+
+        if(reply == REPLY_INCOMPLETE){
+          break;
+        }
+        if(reply == REPLY_NONE){
+          probe_keep_input(&buffer[i], 1);
+        } else {
+          probe_handle(reply, &result);
+          answered = reply == REPLY_DA1;
+        }
+
+        i += used;
+      }
+
+      //anything after the last reply is input
+      if(answered){
+        probe_keep_input(&buffer[i], length - i);
+        i = length;
+      }
+
+      memmove(buffer, &buffer[i], length - i);
+      length -= i;
+
+      if(length == sizeof(buffer)){
+        probe_keep_input(buffer, length);
+        length = 0;
+      }
+    }
+
+    probe_keep_input(buffer, length);
+    input_parse(false);
+  }
+
+  if(capabilities.flags & TGE_CAP_TRUECOLOR){
+    colour_mode = TGE_COLOUR_MODE_TRUECOLOR;
+  }
+
+  return capabilities.flags;
+}
+
+struct tge_capabilities tge_get_capabilities(void){
+  return capabilities;
+}
+
+void tge_set_capabilities(unsigned int flags){
+  capabilities.flags = flags;
+}
+
+//cursor motion: pick the cheapest sequence to get from the tracked cursor
+//position to a target cell, similar to what ncurses' mvcur does
+
+static inline unsigned int digit_count(unsigned int n){
+  unsigned int count = 1;
+
+  while(n >= 10){
+    n /= 10;
+    count++;
+  }
+
+  return count;
+}
+
+static inline unsigned int csi_cost(unsigned int n){
+  return n == 1 ? 3 : 3 + digit_count(n);
+}
+
+static unsigned int absolute_cost(unsigned short x, unsigned short y){
+  if(x == 1 && y == 1){
+    return 3;
+  }
+  if(x == 1){
+    return 3 + digit_count(y);
+  }
+
+  return 4 + digit_count(y) + digit_count(x);
+}
+
+static void emit_absolute(unsigned short x, unsigned short y){
+  if(x == 1 && y == 1){
+    out_literal(TGE_CURSOR_HOME);
+  } else if(x == 1){
+    out_literal("\x1B[");
+    out_uint(y);
+    out_char('H');
+  } else {
+    out_literal("\x1B[");
+    out_uint(y);
+    out_char(';');
+    out_uint(x);
+    out_char('H');
+  }
+}
+
+//moving right can be done by reprinting the cells in between when they
+//already hold what the terminal shows. Return the bytes that takes, or
+//limit if it is not possible or would not be cheaper
+static unsigned int overwrite_cost(unsigned short from_x, unsigned short to_x, unsigned short y, unsigned int limit){
+  size_t row = (size_t)(y - 1) * buffer_cols;
+  unsigned int cost = 0;
+
+  //every glyph takes at least a byte per column
+  if(!terminal_style_known || (unsigned int)(to_x - from_x) >= limit || back_buffer[row + from_x - 1].width == 0){
+    return limit;
+  }
+
+  for(unsigned short x = from_x; x < to_x; x++){
+    const struct cell* cell = &back_buffer[row + x - 1];
+
+    if(memcmp(&front_buffer[row + x - 1], cell, sizeof(struct cell)) != 0 || !cell_has_style(cell, &terminal_style)){
+      return limit;
+    }
+
+    //the continuation half of a wide glyph is printed with it
+    if(cell->width != 0){
+      cost += utf8_length(cell->ch);
+    }
+
+    if(cost >= limit){
+      return limit;
+    }
+  }
+
+  return cost;
+}
+
+static unsigned int horizontal_cost(unsigned short from_x, unsigned short to_x, unsigned short y){
+  if(to_x > from_x){
+    return overwrite_cost(from_x, to_x, y, csi_cost(to_x - from_x));
+  }
+  if(to_x < from_x){
+    unsigned int n = from_x - to_x;
+    unsigned int cost = csi_cost(n);
+
+    //backspace moves one column left per byte
+    return n < cost ? n : cost;
+  }
+
+  return 0;
+}
+
+static void emit_horizontal(unsigned short from_x, unsigned short to_x, unsigned short y){
+  if(to_x > from_x){
+    unsigned int n = to_x - from_x;
+
+    if(overwrite_cost(from_x, to_x, y, csi_cost(n)) < csi_cost(n)){
+      const struct cell* cells = &back_buffer[(size_t)(y - 1) * buffer_cols + from_x - 1];
+
+      for(unsigned int i = 0; i < n; i++){
+        if(cells[i].width != 0){
+          out_utf8(cells[i].ch);
+        }
+      }
+    } else {
+      out_csi(n, 'C');
+    }
+  } else if(to_x < from_x){
+    unsigned int n = from_x - to_x;
+
+    if(n < csi_cost(n)){
+      for(unsigned int i = 0; i < n; i++){
+        out_char('\b');
+      }
+    } else {
+      out_csi(n, 'D');
+    }
+  }
+}
+
+static unsigned int vertical_cost(unsigned short from_y, unsigned short to_y){
+  if(to_y > from_y){
+    return csi_cost(to_y - from_y);
+  }
+  if(to_y < from_y){
+    return csi_cost(from_y - to_y);
+  }
+
+  return 0;
+}
+
+static void emit_vertical(unsigned short from_y, unsigned short to_y){
+  if(to_y > from_y){
+    out_csi(to_y - from_y, 'B');
+  } else if(to_y < from_y){
+    out_csi(from_y - to_y, 'A');
+  }
+}
+
+//a line feed only returns to the first column when output post processing
+//translates it to CR LF
+static bool newline_returns(void){
+  return (term_cur_flags.c_oflag & OPOST) && (term_cur_flags.c_oflag & ONLCR);
+}
+
+enum cursor_motion {
+  MOTION_ABSOLUTE,
+  MOTION_RELATIVE,
+  MOTION_CARRIAGE_RETURN,
+  MOTION_NEWLINE,
+  MOTION_HOME
+};
+
+static void move_cursor(unsigned short x, unsigned short y){
+  unsigned short cur_x = tge_cursor_x;
+  unsigned short cur_y = tge_cursor_y;
+
+  if(cur_x == x && cur_y == y){
+    return;
+  }
+
+  enum cursor_motion motion = MOTION_ABSOLUTE;
+  unsigned int best = absolute_cost(x, y);
+
+  //relative motion is only safe when the cursor position is known. After
+  //printing in the last column the cursor is left pending a wrap
+  bool known = cur_x >= 1 && cur_x <= buffer_cols && cur_y >= 1 && cur_y <= buffer_rows;
+
+  if(known){
+    unsigned int cost = horizontal_cost(cur_x, x, y) + vertical_cost(cur_y, y);
+    if(cost < best){
+      best = cost;
+      motion = MOTION_RELATIVE;
+    }
+
+    cost = 1 + horizontal_cost(1, x, y) + vertical_cost(cur_y, y);
+    if(cost < best){
+      best = cost;
+      motion = MOTION_CARRIAGE_RETURN;
+    }
+
+    if(y > cur_y && newline_returns()){
+      cost = (y - cur_y) + horizontal_cost(1, x, y);
+      if(cost < best){
+        best = cost;
+        motion = MOTION_NEWLINE;
+      }
+    }
+  }
+
+  unsigned int cost = 3 + horizontal_cost(1, x, y) + vertical_cost(1, y);
+  if(cost < best){
+    best = cost;
+    motion = MOTION_HOME;
+  }
+
+  switch(motion){
+    case MOTION_ABSOLUTE:
+      emit_absolute(x, y);
+      break;
+    case MOTION_RELATIVE:
+      emit_vertical(cur_y, y);
+      emit_horizontal(cur_x, x, y);
+      break;
+    case MOTION_CARRIAGE_RETURN:
+      out_char('\r');
+      emit_vertical(cur_y, y);
+      emit_horizontal(1, x, y);
+      break;
+    case MOTION_NEWLINE:
+      for(unsigned short i = cur_y; i < y; i++){
+        out_char('\n');
+      }
+      emit_horizontal(1, x, y);
+      break;
+    case MOTION_HOME:
+      out_literal(TGE_CURSOR_HOME);
+      emit_vertical(1, y);
+      emit_horizontal(1, x, y);
+      break;
+  }
+
+  tge_cursor_x = x;
+  tge_cursor_y = y;
+}
+
+//cells are 1 based to match terminal coordinates
+static inline struct cell* back_buffer_cell(int x, int y){
+  return &back_buffer[(size_t)(y - 1) * buffer_cols + (x - 1)];
+}
+
+//display width of codepoints outside printable ASCII, as first, last, width.
+//Ranges not listed are one column. Combining marks and other zero width
+//characters are 0, east asian wide, fullwidth and emoji presentation are 2
+static const uint32_t width_ranges[][3] = {
+  { 0x0300, 0x036F, 0 }, { 0x0483, 0x0489, 0 }, { 0x0591, 0x05BD, 0 }, { 0x05BF, 0x05BF, 0 },
+  { 0x05C1, 0x05C2, 0 }, { 0x05C4, 0x05C5, 0 }, { 0x05C7, 0x05C7, 0 }, { 0x0610, 0x061A, 0 },
+  { 0x064B, 0x065F, 0 }, { 0x0670, 0x0670, 0 }, { 0x06D6, 0x06DC, 0 }, { 0x06DF, 0x06E4, 0 },
+  { 0x06E7, 0x06E8, 0 }, { 0x06EA, 0x06ED, 0 }, { 0x0711, 0x0711, 0 }, { 0x0730, 0x074A, 0 },
+  { 0x07A6, 0x07B0, 0 }, { 0x0900, 0x0902, 0 }, { 0x093C, 0x093C, 0 }, { 0x0941, 0x0948, 0 },
+  { 0x094D, 0x094D, 0 }, { 0x0951, 0x0957, 0 }, { 0x0E31, 0x0E31, 0 }, { 0x0E34, 0x0E3A, 0 },
+  { 0x0E47, 0x0E4E, 0 }, { 0x1100, 0x115F, 2 }, { 0x1160, 0x11FF, 0 }, { 0x1AB0, 0x1AFF, 0 },
+  { 0x1DC0, 0x1DFF, 0 }, { 0x200B, 0x200F, 0 }, { 0x202A, 0x202E, 0 }, { 0x2060, 0x2064, 0 },
+  { 0x20D0, 0x20FF, 0 }, { 0x231A, 0x231B, 2 }, { 0x2329, 0x232A, 2 }, { 0x23E9, 0x23EC, 2 },
+  { 0x23F0, 0x23F0, 2 }, { 0x23F3, 0x23F3, 2 }, { 0x25FD, 0x25FE, 2 }, { 0x2614, 0x2615, 2 },
+  { 0x2648, 0x2653, 2 }, { 0x267F, 0x267F, 2 }, { 0x2693, 0x2693, 2 }, { 0x26A1, 0x26A1, 2 },
+  { 0x26AA, 0x26AB, 2 }, { 0x26BD, 0x26BE, 2 }, { 0x26C4, 0x26C5, 2 }, { 0x26CE, 0x26CE, 2 },
+  { 0x26D4, 0x26D4, 2 }, { 0x26EA, 0x26EA, 2 }, { 0x26F2, 0x26F3, 2 }, { 0x26F5, 0x26F5, 2 },
+  { 0x26FA, 0x26FA, 2 }, { 0x26FD, 0x26FD, 2 }, { 0x2705, 0x2705, 2 }, { 0x270A, 0x270B, 2 },
+  { 0x2728, 0x2728, 2 }, { 0x274C, 0x274C, 2 }, { 0x274E, 0x274E, 2 }, { 0x2753, 0x2755, 2 },
+  { 0x2757, 0x2757, 2 }, { 0x2795, 0x2797, 2 }, { 0x27B0, 0x27B0, 2 }, { 0x27BF, 0x27BF, 2 },
+  { 0x2B1B, 0x2B1C, 2 }, { 0x2B50, 0x2B50, 2 }, { 0x2B55, 0x2B55, 2 }, { 0x2E80, 0x303E, 2 },
+  { 0x3041, 0x33FF, 2 }, { 0x3400, 0x4DBF, 2 }, { 0x4E00, 0x9FFF, 2 }, { 0xA000, 0xA4CF, 2 },
+  { 0xA960, 0xA97F, 2 }, { 0xAC00, 0xD7A3, 2 }, { 0xF900, 0xFAFF, 2 }, { 0xFE00, 0xFE0F, 0 },
+  { 0xFE10, 0xFE19, 2 }, { 0xFE20, 0xFE2F, 0 }, { 0xFE30, 0xFE6F, 2 }, { 0xFEFF, 0xFEFF, 0 },
+  { 0xFF00, 0xFF60, 2 }, { 0xFFE0, 0xFFE6, 2 }, { 0x16FE0, 0x16FE4, 2 }, { 0x17000, 0x18CFF, 2 },
+  { 0x1B000, 0x1B2FF, 2 }, { 0x1F004, 0x1F004, 2 }, { 0x1F0CF, 0x1F0CF, 2 }, { 0x1F18E, 0x1F18E, 2 },
+  { 0x1F191, 0x1F19A, 2 }, { 0x1F200, 0x1F202, 2 }, { 0x1F210, 0x1F23B, 2 }, { 0x1F240, 0x1F248, 2 },
+  { 0x1F250, 0x1F251, 2 }, { 0x1F260, 0x1F265, 2 }, { 0x1F300, 0x1F320, 2 }, { 0x1F32D, 0x1F335, 2 },
+  { 0x1F337, 0x1F37C, 2 }, { 0x1F37E, 0x1F393, 2 }, { 0x1F3A0, 0x1F3CA, 2 }, { 0x1F3CF, 0x1F3D3, 2 },
+  { 0x1F3E0, 0x1F3F0, 2 }, { 0x1F3F4, 0x1F3F4, 2 }, { 0x1F3F8, 0x1F43E, 2 }, { 0x1F440, 0x1F440, 2 },
+  { 0x1F442, 0x1F4FC, 2 }, { 0x1F4FF, 0x1F53D, 2 }, { 0x1F54B, 0x1F54E, 2 }, { 0x1F550, 0x1F567, 2 },
+  { 0x1F57A, 0x1F57A, 2 }, { 0x1F595, 0x1F596, 2 }, { 0x1F5A4, 0x1F5A4, 2 }, { 0x1F5FB, 0x1F64F, 2 },
+  { 0x1F680, 0x1F6C5, 2 }, { 0x1F6CC, 0x1F6CC, 2 }, { 0x1F6D0, 0x1F6D2, 2 }, { 0x1F6D5, 0x1F6D7, 2 },
+  { 0x1F6DC, 0x1F6DF, 2 }, { 0x1F6EB, 0x1F6EC, 2 }, { 0x1F6F4, 0x1F6FC, 2 }, { 0x1F7E0, 0x1F7EB, 2 },
+  { 0x1F7F0, 0x1F7F0, 2 }, { 0x1F90C, 0x1F93A, 2 }, { 0x1F93C, 0x1F945, 2 }, { 0x1F947, 0x1F9FF, 2 },
+  { 0x1FA70, 0x1FAFF, 2 }, { 0x20000, 0x2FFFD, 2 }, { 0x30000, 0x3FFFD, 2 }, { 0xE0001, 0xE0001, 0 },
+  { 0xE0020, 0xE007F, 0 }, { 0xE0100, 0xE01EF, 0 }
+};
+
+#define WIDTH_RANGE_COUNT (sizeof(width_ranges) / sizeof(width_ranges[0]))
+
+unsigned int tge_glyph_width(uint32_t codepoint){
+  //printable ASCII covers almost every glyph drawn
+  if(codepoint >= 0x20 && codepoint < 0x7F){
+    return 1;
+  }
+  if(codepoint < 0xA0 || codepoint > 0x10FFFF){
+    return 0;
+  }
+
+  unsigned int low = 0;
+  unsigned int high = WIDTH_RANGE_COUNT;
+
+  while(low < high){
+    unsigned int middle = low + (high - low) / 2;
+
+    if(codepoint < width_ranges[middle][0]){
+      high = middle;
+    } else if(codepoint > width_ranges[middle][1]){
+      low = middle + 1;
+    } else {
+      return width_ranges[middle][2];
+    }
+  }
+
+  return 1;
+}
+
+//decode the UTF-8 character at text. Invalid bytes decode to U+FFFD one at a
+//time. Return the bytes used
+static unsigned int utf8_decode(const unsigned char* text, uint32_t* codepoint){
+  unsigned char c = text[0];
+
+  if(c < 0x80){
+    *codepoint = c;
+    return 1;
+  }
+
+  unsigned int length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+
+  *codepoint = 0xFFFD;
+
+  if(length == 1 || c >= 0xF8){
+    return 1;
+  }
+
+  uint32_t decoded = c & (0x7F >> length);
+
+  //the NUL terminator is not a continuation byte, so this never reads past it
+  for(unsigned int i = 1; i < length; i++){
+    if((text[i] & 0xC0) != 0x80){
+      return 1;
+    }
+
+    decoded = (decoded << 6) | (text[i] & 0x3F);
+  }
+
+  *codepoint = decoded;
+
+  return length;
+}
+
+struct tge_sprite tge_sprite_create(const char* text){
+  struct tge_sprite sprite = { 0 };
+
+  size_t length = strlen(text);
+  size_t height = 0;
+
+  for(size_t i = 0; i < length; i++){
+    if(text[i] == '\n'){
+      height++;
+    }
+  }
+
+  //a trailing newline does not start another row
+  if(length > 0 && text[length - 1] != '\n'){
+    height++;
+  }
+
+  //sizes are kept in 16 bits, as in packs
+  if(height > UINT16_MAX || length > UINT32_MAX / sizeof(struct tge_glyph)){
+    return sprite;
+  }
+
+  //spans, glyphs and a copy of the text share one allocation. There are never
+  //more glyphs than bytes
+  char* block = malloc(height * sizeof(struct tge_span) + length * sizeof(struct tge_glyph) + length + 1);
+
+  if(block == NULL){
+    return sprite;
+  }
+
+  struct tge_span* rows = (struct tge_span*)block;
+  struct tge_glyph* glyphs = (struct tge_glyph*)(block + height * sizeof(struct tge_span));
+  char* copy = (char*)(glyphs + length);
+  memcpy(copy, text, length + 1);
+
+  unsigned int glyph_count = 0;
+  unsigned int row_width = 0;
+  unsigned int width = 0;
+  unsigned short row = 0;
+
+  if(height > 0){
+    rows[0].start = 0;
+  }
+
+  for(size_t i = 0; i <= length && row < height;){
+    if(i == length || copy[i] == '\n'){
+      rows[row].length = glyph_count - rows[row].start;
+
+      if(row_width > width){
+        width = row_width;
+      }
+
+      row++;
+      i++;
+      row_width = 0;
+
+      if(row < height){
+        rows[row].start = glyph_count;
+      }
+
+      continue;
+    }
+
+    uint32_t codepoint;
+    i += utf8_decode((const unsigned char*)&copy[i], &codepoint);
+
+    //cells hold one codepoint, so combining and control characters are dropped
+    unsigned int glyph_width = tge_glyph_width(codepoint);
+
+    if(glyph_width != 0){
+      glyphs[glyph_count++] = (struct tge_glyph){ .codepoint = codepoint, .width = glyph_width };
+      row_width += glyph_width;
+    }
+  }
+
+  if(width > UINT16_MAX){
+    free(block);
+    return sprite;
+  }
+
+  sprite.text = copy;
+  sprite.width = width;
+  sprite.length = length;
+  sprite.height = height;
+  sprite.rows = rows;
+  sprite.glyphs = glyphs;
+  sprite.glyph_count = glyph_count;
+
+  return sprite;
+}
+
+void tge_sprite_destroy(struct tge_sprite* sprite){
+  free((void*)sprite->rows);
+
+  sprite->text = NULL;
+  sprite->rows = NULL;
+  sprite->glyphs = NULL;
+  sprite->glyph_count = 0;
+  sprite->length = 0;
+  sprite->width = 0;
+  sprite->height = 0;
+}
+
+static struct rect sprite_bounds(const struct tge_sprite* sprite, struct tge_vec3 pos){
+  struct rect bounds = {
+    .left = pos.x,
+    .top = pos.y,
+    .right = pos.x + (int)sprite->width - 1,
+    .bottom = pos.y + (int)sprite->height - 1
+  };
+
+  return bounds;
+}
+
+//trim a rectangle to the viewport. Return false if nothing is left of it
+static bool clip_to_viewport(struct rect* rect){
+  if(rect->left < 1){
+    rect->left = 1;
+  }
+  if(rect->top < 1){
+    rect->top = 1;
+  }
+  if(rect->right > buffer_cols){
+    rect->right = buffer_cols;
+  }
+  if(rect->bottom > buffer_rows){
+    rect->bottom = buffer_rows;
+  }
+
+  return rect->left <= rect->right && rect->top <= rect->bottom;
+}
+
+static inline bool rects_intersect(const struct rect* a, const struct rect* b){
+  return a->left <= b->right && b->left <= a->right && a->top <= b->bottom && b->top <= a->bottom;
+}
+
+//draw or clear the part of an object inside clip, which must lie within the
+//viewport. NULL clips to the viewport. A wide glyph crossing the edge of clip
+//is still drawn whole as long as it fits on screen
+static void fill_game_object(const struct tge_game_object* game_object, bool clear, const struct rect* clip){
+  const struct tge_sprite* sprite = game_object->sprite;
+
+  if(sprite->width == 0 || sprite->height == 0){
+    return;
+  }
+
+  struct rect visible = sprite_bounds(sprite, game_object->pos);
+
+  //objects entirely off screen are skipped without looking at their rows
+  if(clip == NULL ? !clip_to_viewport(&visible) : !rects_intersect(&visible, clip)){
+    return;
+  }
+
+  if(clip != NULL){
+    visible.left = visible.left > clip->left ? visible.left : clip->left;
+    visible.top = visible.top > clip->top ? visible.top : clip->top;
+    visible.right = visible.right < clip->right ? visible.right : clip->right;
+    visible.bottom = visible.bottom < clip->bottom ? visible.bottom : clip->bottom;
+  }
+
+  struct tge_style style = {
+    .fg = colour_for_mode(game_object->style.fg),
+    .bg = colour_for_mode(game_object->style.bg),
+    .attrs = game_object->style.attrs
+  };
+
+  for(int y = visible.top; y <= visible.bottom; y++){
+    const struct tge_span* span = &sprite->rows[y - game_object->pos.y];
+    const struct tge_glyph* glyphs = &sprite->glyphs[span->start];
+    struct cell* row = back_buffer_cell(1, y);
+    int x = game_object->pos.x;
+    int first = 0;
+    int last = 0;
+
+    for(unsigned int i = 0; i < span->length && x <= visible.right; i++){
+      int width = glyphs[i].width;
+      int end = x + width - 1;
+
+      if(end >= visible.left){
+        int from = x < visible.left ? visible.left : x;
+        int to = end > visible.right ? visible.right : end;
+
+        if(x >= 1 && end <= buffer_cols){
+          from = x;
+          to = end;
+        }
+
+        if(first == 0){
+          first = from;
+        }
+        last = to;
+
+        if(clear){
+          for(int column = from; column <= to; column++){
+            row[column - 1] = blank_cell;
+          }
+        } else if(from != x || to != end){
+          //a wide glyph cut by the viewport edge shows as blank
+          for(int column = from; column <= to; column++){
+            row[column - 1] = (struct cell){ .fg = style.fg, .bg = style.bg, .ch = ' ', .attrs = style.attrs, .width = 1 };
+          }
+        } else {
+          row[x - 1] = (struct cell){ .fg = style.fg, .bg = style.bg, .ch = glyphs[i].codepoint, .attrs = style.attrs, .width = width };
+
+          if(width == 2){
+            row[x] = (struct cell){ .fg = style.fg, .bg = style.bg, .attrs = style.attrs };
+          }
+        }
+      }
+
+      x += width;
+    }
+
+    if(first == 0){
+      continue;
+    }
+
+    //a wide glyph partly overwritten loses its other half too
+    if(first > 1 && row[first - 2].width == 2){
+      row[first - 2].ch = ' ';
+      row[first - 2].width = 1;
+    }
+    if(last < buffer_cols && row[last].width == 0 && row[last - 1].width != 2){
+      row[last].ch = ' ';
+      row[last].width = 1;
+    }
+  }
+}
+
+void tge_draw_game_object(struct tge_game_object game_object){
+  fill_game_object(&game_object, false, NULL);
+}
+
+void tge_clear_game_object(struct tge_game_object game_object){
+  fill_game_object(&game_object, true, NULL);
+}
+
+//order by z, keeping call order for equal z so overlaps are deterministic
+static int compare_depth(const void* a, const void* b){
+  const struct tge_game_object* object_a = *(const struct tge_game_object**)a;
+  const struct tge_game_object* object_b = *(const struct tge_game_object**)b;
+
+  if(object_a->pos.z != object_b->pos.z){
+    return object_a->pos.z < object_b->pos.z ? -1 : 1;
+  }
+
+  return object_a < object_b ? -1 : object_a > object_b;
+}
+
+void tge_draw_scene(const struct tge_game_object* objects, size_t count){
+  if(count > scene_order_capacity){
+    const struct tge_game_object** new_order = realloc(scene_order, count * sizeof(*new_order));
+
+    if(new_order == NULL){
+      return;
+    }
+
+    scene_order = new_order;
+    scene_order_capacity = count;
+  }
+
+  bool sorted = true;
+
+  for(size_t i = 0; i < count; i++){
+    scene_order[i] = &objects[i];
+
+    if(i > 0 && objects[i].pos.z < objects[i - 1].pos.z){
+      sorted = false;
+    }
+  }
+
+  if(!sorted){
+    qsort(scene_order, count, sizeof(*scene_order), compare_depth);
+  }
+
+  //painting back to front leaves the top object in every cell. tge_present
+  //then emits the result in row major order regardless of draw order
+  for(size_t i = 0; i < count; i++){
+    fill_game_object(scene_order[i], false, NULL);
+  }
+}
+
+//registry: objects the engine keeps and repaints itself. Changes mark the
+//area they touch as damaged and tge_present repaints only those areas
+
+static inline bool rects_touch(const struct rect* a, const struct rect* b){
+  return a->left <= b->right + 1 && b->left <= a->right + 1 && a->top <= b->bottom + 1 && b->top <= a->bottom + 1;
+}
+
+static inline void rect_union(struct rect* a, const struct rect* b){
+  a->left = a->left < b->left ? a->left : b->left;
+  a->top = a->top < b->top ? a->top : b->top;
+  a->right = a->right > b->right ? a->right : b->right;
+  a->bottom = a->bottom > b->bottom ? a->bottom : b->bottom;
+}
+
+static void add_damage(struct rect rect){
+  if(!clip_to_viewport(&rect)){
+    return;
+  }
+
+  //merging can make the result touch rects already checked, so start over
+  for(unsigned int i = 0; i < damage_count;){
+    if(rects_touch(&damage[i], &rect)){
+      rect_union(&rect, &damage[i]);
+      damage[i] = damage[--damage_count];
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+
+  if(damage_count == MAX_DAMAGE_RECTS){
+    for(unsigned int i = 0; i < damage_count; i++){
+      rect_union(&rect, &damage[i]);
+    }
+
+    damage_count = 0;
+  }
+
+  damage[damage_count++] = rect;
+}
+
+//where a registry object appears on screen
+static inline struct tge_game_object object_on_screen(const struct registry_slot* slot){
+  struct tge_game_object object = slot->object;
+
+  object.pos.x -= camera_x;
+  object.pos.y -= camera_y;
+
+  return object;
+}
+
+static void damage_object(struct registry_slot* slot){
+  if(slot->object.sprite != NULL && slot->object.sprite->width > 0 && slot->object.sprite->height > 0){
+    struct tge_game_object object = object_on_screen(slot);
+    add_damage(sprite_bounds(object.sprite, object.pos));
+  }
+}
+
+static struct registry_slot* registry_lookup(tge_handle handle){
+  unsigned int index = (handle & HANDLE_INDEX_MASK) - 1;
+
+  if((handle & HANDLE_INDEX_MASK) == 0 || index >= registry_capacity){
+    return NULL;
+  }
+
+  struct registry_slot* slot = &registry[index];
+
+  if(!slot->live || slot->generation != handle >> HANDLE_INDEX_BITS){
+    return NULL;
+  }
+
+  return slot;
+}
+
+static bool registry_grow(void){
+  unsigned int capacity = registry_capacity == 0 ? 64 : registry_capacity * 2;
+
+  if(capacity > HANDLE_INDEX_MASK){
+    return false;
+  }
+
+  struct registry_slot* new_registry = realloc(registry, capacity * sizeof(struct registry_slot));
+  struct registry_slot** new_order = realloc(registry_order, capacity * sizeof(struct registry_slot*));
+
+  //the order holds pointers into the old array, even if the order fails to grow
+  if(new_registry != NULL){
+    registry = new_registry;
+    registry_order_dirty = true;
+  }
+  if(new_order != NULL){
+    registry_order = new_order;
+  }
+  if(new_registry == NULL || new_order == NULL){
+    return false;
+  }
+
+  //new slots go on the free list lowest index first
+  for(unsigned int i = capacity; i-- > registry_capacity;){
+    registry[i] = (struct registry_slot){ .next_free = registry_free };
+    registry_free = i;
+  }
+
+  registry_capacity = capacity;
+
+  return true;
+}
+
+tge_handle tge_object_create(struct tge_game_object object){
+  if(registry_free == REGISTRY_NIL && !registry_grow()){
+    return 0;
+  }
+
+  unsigned int index = registry_free;
+  struct registry_slot* slot = &registry[index];
+
+  registry_free = slot->next_free;
+
+  slot->object = object;
+  slot->live = true;
+  registry_order_dirty = true;
+  damage_object(slot);
+
+  return (slot->generation << HANDLE_INDEX_BITS) | (index + 1);
+}
+
+bool tge_object_destroy(tge_handle handle){
+  struct registry_slot* slot = registry_lookup(handle);
+
+  if(slot == NULL){
+    return false;
+  }
+
+  damage_object(slot);
+
+  slot->live = false;
+  slot->generation = (slot->generation + 1) & (UINT32_MAX >> HANDLE_INDEX_BITS);
+  slot->next_free = registry_free;
+  registry_free = slot - registry;
+  registry_order_dirty = true;
+
+  return true;
+}
+
+bool tge_object_move(tge_handle handle, struct tge_vec3 pos){
+  struct registry_slot* slot = registry_lookup(handle);
+
+  if(slot == NULL){
+    return false;
+  }
+
+  if(pos.x == slot->object.pos.x && pos.y == slot->object.pos.y && pos.z == slot->object.pos.z){
+    return true;
+  }
+
+  damage_object(slot);
+
+  if(pos.z != slot->object.pos.z){
+    registry_order_dirty = true;
+  }
+
+  slot->object.pos = pos;
+  damage_object(slot);
+
+  return true;
+}
+
+bool tge_object_set_sprite(tge_handle handle, const struct tge_sprite* sprite){
+  struct registry_slot* slot = registry_lookup(handle);
+
+  if(slot == NULL){
+    return false;
+  }
+
+  damage_object(slot);
+  slot->object.sprite = sprite;
+  damage_object(slot);
+
+  return true;
+}
+
+bool tge_object_set_style(tge_handle handle, struct tge_style style){
+  struct registry_slot* slot = registry_lookup(handle);
+
+  if(slot == NULL){
+    return false;
+  }
+
+  slot->object.style = style;
+  damage_object(slot);
+
+  return true;
+}
+
+const struct tge_game_object* tge_object_get(tge_handle handle){
+  struct registry_slot* slot = registry_lookup(handle);
+
+  return slot != NULL ? &slot->object : NULL;
+}
+
+void tge_object_damage(tge_handle handle){
+  struct registry_slot* slot = registry_lookup(handle);
+
+  if(slot != NULL){
+    damage_object(slot);
+  }
+}
+
+//order by z, then slot, so overlaps are deterministic
+static int compare_slot_depth(const void* a, const void* b){
+  const struct registry_slot* slot_a = *(const struct registry_slot**)a;
+  const struct registry_slot* slot_b = *(const struct registry_slot**)b;
+
+  if(slot_a->object.pos.z != slot_b->object.pos.z){
+    return slot_a->object.pos.z < slot_b->object.pos.z ? -1 : 1;
+  }
+
+  return slot_a < slot_b ? -1 : slot_a > slot_b;
+}
+
+//blank each damaged area and paint every object overlapping it, back to front
+//if a wide glyph of object covers screen column x on row y, set start to
+//its first column and return true
+static bool wide_glyph_at(const struct tge_game_object* object, int x, int y, int* start){
+  const struct tge_sprite* sprite = object->sprite;
+
+  if(y < object->pos.y || y >= object->pos.y + sprite->height || x < object->pos.x || x >= object->pos.x + sprite->width){
+    return false;
+  }
+
+  const struct tge_span* span = &sprite->rows[y - object->pos.y];
+  const struct tge_glyph* glyphs = &sprite->glyphs[span->start];
+  int column = object->pos.x;
+
+  for(unsigned int i = 0; i < span->length && column <= x; i++){
+    if(x < column + (int)glyphs[i].width){
+      *start = column;
+      return glyphs[i].width == 2;
+    }
+
+    column += glyphs[i].width;
+  }
+
+  return false;
+}
+
+//objects are painted whole glyph by whole glyph, so a wide glyph crossing
+//the edge of a damaged area would land a column outside it, on top of
+//whatever is there. Grow the area until no glyph crosses its edges
+static void widen_to_glyphs(struct rect* rect){
+  bool widened = true;
+
+  while(widened){
+    widened = false;
+
+    for(unsigned int i = 0; i < registry_order_count; i++){
+      if(registry_order[i]->object.sprite == NULL){
+        continue;
+      }
+
+      struct tge_game_object object = object_on_screen(registry_order[i]);
+      int start;
+
+      for(int y = rect->top; y <= rect->bottom; y++){
+        if(rect->left > 1 && wide_glyph_at(&object, rect->left, y, &start) && start == rect->left - 1){
+          rect->left--;
+          widened = true;
+        }
+        if(rect->right < buffer_cols && wide_glyph_at(&object, rect->right, y, &start) && start == rect->right){
+          rect->right++;
+          widened = true;
+        }
+      }
+    }
+  }
+}
+
+static void repaint_damage(void){
+  if(damage_count == 0){
+    return;
+  }
+
+  if(registry_order_dirty){
+    registry_order_count = 0;
+
+    for(unsigned int i = 0; i < registry_capacity; i++){
+      if(registry[i].live){
+        registry_order[registry_order_count++] = &registry[i];
+      }
+    }
+
+    qsort(registry_order, registry_order_count, sizeof(*registry_order), compare_slot_depth);
+    registry_order_dirty = false;
+  }
+
+  for(unsigned int d = 0; d < damage_count; d++){
+    struct rect* rect = &damage[d];
+
+    widen_to_glyphs(rect);
+
+    for(int y = rect->top; y <= rect->bottom; y++){
+      struct cell* row = back_buffer_cell(1, y);
+
+      for(int x = rect->left; x <= rect->right; x++){
+        row[x - 1] = blank_cell;
+      }
+
+      //a wide glyph cut by the area loses its outside half, which the
+      //object owning it paints again below
+      if(rect->left > 1 && row[rect->left - 2].width == 2){
+        row[rect->left - 2] = blank_cell;
+      }
+      if(rect->right < buffer_cols && row[rect->right].width == 0){
+        row[rect->right] = blank_cell;
+      }
+    }
+
+    for(unsigned int i = 0; i < registry_order_count; i++){
+      if(registry_order[i]->object.sprite != NULL){
+        struct tge_game_object object = object_on_screen(registry_order[i]);
+        fill_game_object(&object, false, rect);
+      }
+    }
+  }
+
+  damage_count = 0;
+}
+
+static inline unsigned short region_top(void){
+  return scroll_top != 0 && scroll_top <= buffer_rows ? scroll_top : 1;
+}
+
+static inline unsigned short region_bottom(void){
+  return scroll_bottom != 0 && scroll_bottom <= buffer_rows ? scroll_bottom : buffer_rows;
+}
+
+static void damage_all(void){
+  damage_count = 0;
+  add_damage((struct rect){ 1, 1, buffer_cols, buffer_rows });
+}
+
+//the terminal reflows its content on resize, so start from a blank screen.
+//Damage and scrolling recorded before were clipped to the old size, so they
+//are dropped and registry objects are painted again over the whole screen
+static void screen_resized(void){
+  framebuffer_resize();
+  tge_clear();
+
+  //terminals move the cursor when resizing and the clear does not home it,
+  //so the next move is absolute
+  tge_cursor_x = 0;
+  tge_cursor_y = 0;
+
+  damage_count = 0;
+  scroll_pending = 0;
+
+  if(registry_order_count > 0 || registry_order_dirty){
+    damage_all();
+  }
+}
+
+void tge_set_camera(int x, int y){
+  int dx = x - camera_x;
+  int dy = y - camera_y;
+
+  if(dx == 0 && dy == 0){
+    return;
+  }
+
+  camera_x = x;
+  camera_y = y;
+
+  //there is no way to shift the screen sideways, so everything is redrawn
+  if(dx != 0){
+    scroll_pending = 0;
+    damage_all();
+    return;
+  }
+
+  //areas damaged before the move hold content the scroll is going to shift,
+  //so they cover both where it is now and where it ends up
+  struct rect old[MAX_DAMAGE_RECTS];
+  unsigned int count = damage_count;
+
+  memcpy(old, damage, count * sizeof(struct rect));
+  damage_count = 0;
+
+  for(unsigned int i = 0; i < count; i++){
+    struct rect shifted = old[i];
+
+    shifted.top -= dy;
+    shifted.bottom -= dy;
+    rect_union(&shifted, &old[i]);
+    add_damage(shifted);
+  }
+
+  scroll_pending += dy;
+}
+
+void tge_get_camera(int* x, int* y){
+  *x = camera_x;
+  *y = camera_y;
+}
+
+void tge_set_scroll_region(unsigned short top, unsigned short bottom){
+  scroll_top = top;
+  scroll_bottom = bottom;
+}
+
+//move the rows of the scroll region n rows up, or down for negative n, in
+//both buffers and on the terminal. Rows scrolled in are blank
+static void scroll_buffers(int n){
+  unsigned short top = region_top();
+  unsigned short bottom = region_bottom();
+  unsigned int count = n > 0 ? n : -n;
+  size_t row_size = (size_t)buffer_cols * sizeof(struct cell);
+  size_t moved = (size_t)(bottom - top + 1 - count) * row_size;
+  struct cell* buffers[2] = { front_buffer, back_buffer };
+
+  for(int b = 0; b < 2; b++){
+    struct cell* region = &buffers[b][(size_t)(top - 1) * buffer_cols];
+    struct cell* blank_rows = region;
+
+    if(n > 0){
+      memmove(region, region + (size_t)count * buffer_cols, moved);
+      blank_rows = region + (moved / sizeof(struct cell));
     } else {
-      cur_x++;
+      memmove(region + (size_t)count * buffer_cols, region, moved);
+    }
+
+    for(size_t i = 0; i < (size_t)count * buffer_cols; i++){
+      blank_rows[i] = blank_cell;
     }
+  }
+
+  //terminals fill scrolled in rows with the current background
+  if(!terminal_style_known || !style_is_default(&terminal_style)){
+    out_literal(TGE_STYLE_RESET);
+    terminal_style = (struct tge_style){ 0 };
+    terminal_style_known = true;
+  }
+
+  bool whole_screen = top == 1 && bottom == buffer_rows;
+
+  //setting a scroll region homes the cursor, and it is reset right away so
+  //line feeds used for cursor motion never scroll
+  if(!whole_screen){
+    out_literal("\x1B[");
+    out_uint(top);
+    out_char(';');
+    out_uint(bottom);
+    out_char('r');
+  }
+
+  out_csi(count, n > 0 ? 'S' : 'T');
+
+  if(!whole_screen){
+    out_literal("\x1B[r");
+    tge_cursor_x = 1;
+    tge_cursor_y = 1;
+  }
+
+  if(n > 0){
+    add_damage((struct rect){ 1, bottom - count + 1, buffer_cols, bottom });
+  } else {
+    add_damage((struct rect){ 1, top, buffer_cols, top + count - 1 });
+  }
+
+  //objects outside the region move with the camera too
+  if(top > 1){
+    add_damage((struct rect){ 1, 1, buffer_cols, top - 1 });
+  }
+  if(bottom < buffer_rows){
+    add_damage((struct rect){ 1, bottom + 1, buffer_cols, buffer_rows });
+  }
+}
+
+//erasing leaves blanks with no style, other than the current background on
+//terminals with back colour erase
+static inline bool cell_is_erased(const struct cell* cell){
+  return cell->ch == ' ' && cell->width == 1 && cell->fg == TGE_COLOUR_DEFAULT && cell->attrs == 0 &&
+         (cell->bg == TGE_COLOUR_DEFAULT || (capabilities.flags & TGE_CAP_BCE));
+}
+
+//output a run of count identical cells starting at the cursor, in 0 based
+//column x, as one erase or repeat sequence when that is shorter than
+//printing every cell
+static void emit_run(const struct cell* cell, unsigned short x, unsigned int count){
+  bool erased = cell_is_erased(cell);
+
+  emit_style(cell);
+
+  //erasing to the end of the line takes three bytes however long the run
+  if(erased && x + count == buffer_cols && count > 3){
+    out_literal("\x1B[K");
+    return;
+  }
+
+  //ECH leaves the cursor where it is, so allow for moving past the run
+  //again afterwards
+  if(erased && (capabilities.flags & TGE_CAP_ECH) && csi_cost(count) * 2 < count){
+    out_csi(count, 'X');
+    return;
+  }
+
+  out_utf8(cell->ch);
+  tge_cursor_x += count;
 
-    itr++;
+  if(count > 1 && (capabilities.flags & TGE_CAP_REP) && csi_cost(count - 1) < (count - 1) * utf8_length(cell->ch)){
+    out_csi(count - 1, 'b');
+    return;
+  }
+
+  for(unsigned int i = 1; i < count; i++){
+    out_utf8(cell->ch);
   }
 }
 
-void tge_clear_game_object(struct tge_game_object game_object){
-  char* itr = game_object.text;
+//the length of the run of changed cells equal to the one at x, y in the
+//back buffer. Blanks that reach the end of the row are all included, changed
+//or not, so they can be erased at once
+static unsigned int run_length(unsigned short x, unsigned short y){
+  const struct cell* row = &back_buffer[(size_t)y * buffer_cols];
+  const struct cell* shown = &front_buffer[(size_t)y * buffer_cols];
+  unsigned short end = x + 1;
+
+  while(end < buffer_cols && memcmp(&row[end], &row[x], sizeof(struct cell)) == 0 &&
+        memcmp(&shown[end], &row[x], sizeof(struct cell)) != 0){
+    end++;
+  }
 
-  int cur_x = game_object.pos.x;
-  int cur_y = game_object.pos.y;
+  if(cell_is_erased(&row[x])){
+    unsigned short blank_end = end;
 
-  while(*itr != '\0'){
-    tge_cursor_move_xy(cur_x, cur_y);
+    while(blank_end < buffer_cols && memcmp(&row[blank_end], &row[x], sizeof(struct cell)) == 0){
+      blank_end++;
+    }
+
+    if(blank_end == buffer_cols){
+      return blank_end - x;
+    }
+  }
+
+  return end - x;
+}
+
+//frame diffing. A scan returns the first cell from x on, before count, that
+//is equal in both rows when equal is true or differs when it is false, or
+//count if there is none. Unchanged stretches are usually long, so the
+//vector versions look for differences a block of cells at a time
+typedef unsigned short (*scan_function)(const struct cell* a, const struct cell* b, unsigned short x, unsigned short count, bool equal);
+
+static unsigned short scan_scalar(const struct cell* a, const struct cell* b, unsigned short x, unsigned short count, bool equal){
+  for(; x < count; x++){
+    if((memcmp(&a[x], &b[x], sizeof(struct cell)) == 0) == equal){
+      break;
+    }
+  }
+
+  return x;
+}
+
+#ifdef TGE_SIMD_X86
+//a cell is 16 bytes, one SSE2 register
+__attribute__((target("sse2")))
+static unsigned short scan_sse2(const struct cell* a, const struct cell* b, unsigned short x, unsigned short count, bool equal){
+  if(!equal){
+    for(; x + 4 <= count; x += 4){
+      __m128i same = _mm_and_si128(
+        _mm_and_si128(
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&a[x]), _mm_loadu_si128((const __m128i*)&b[x])),
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&a[x + 1]), _mm_loadu_si128((const __m128i*)&b[x + 1]))),
+        _mm_and_si128(
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&a[x + 2]), _mm_loadu_si128((const __m128i*)&b[x + 2])),
+          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&a[x + 3]), _mm_loadu_si128((const __m128i*)&b[x + 3]))));
+
+      if(_mm_movemask_epi8(same) != 0xFFFF){
+        break;
+      }
+    }
+  }
 
-    if(cursor_move_valid(cur_x, cur_y)){
-      putchar(' ');
+  for(; x < count; x++){
+    __m128i same = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)&a[x]), _mm_loadu_si128((const __m128i*)&b[x]));
+
+    if((_mm_movemask_epi8(same) == 0xFFFF) == equal){
+      break;
+    }
+  }
+
+  return x;
+}
+
+//two cells to a register, eight cells a block
+__attribute__((target("avx2")))
+static unsigned short scan_avx2(const struct cell* a, const struct cell* b, unsigned short x, unsigned short count, bool equal){
+  if(!equal){
+    for(; x + 8 <= count; x += 8){
+      __m256i same = _mm256_and_si256(
+        _mm256_and_si256(
+          _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&a[x]), _mm256_loadu_si256((const __m256i*)&b[x])),
+          _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&a[x + 2]), _mm256_loadu_si256((const __m256i*)&b[x + 2]))),
+        _mm256_and_si256(
+          _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&a[x + 4]), _mm256_loadu_si256((const __m256i*)&b[x + 4])),
+          _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&a[x + 6]), _mm256_loadu_si256((const __m256i*)&b[x + 6]))));
+
+      if(_mm256_movemask_epi8(same) != -1){
+        break;
+      }
+    }
+  }
+
+  for(; x + 2 <= count; x += 2){
+    unsigned int mask = _mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)&a[x]), _mm256_loadu_si256((const __m256i*)&b[x])));
+
+    if(((mask & 0xFFFF) == 0xFFFF) == equal){
+      return x;
+    }
+    if((mask >> 16 == 0xFFFF) == equal){
+      return x + 1;
     }
+  }
+
+  return scan_scalar(a, b, x, count, equal);
+}
+#endif
+
+static scan_function scan_cells;
 
-    if(*itr == '\n'){
-      cur_x = game_object.pos.x;
-      cur_y++;
+static void select_scan(void){
+  scan_cells = scan_scalar;
+
+#ifdef TGE_SIMD_X86
+  __builtin_cpu_init();
+
+  if(__builtin_cpu_supports("avx2")){
+    scan_cells = scan_avx2;
+  } else if(__builtin_cpu_supports("sse2")){
+    scan_cells = scan_sse2;
+  }
+#endif
+}
+
+void tge_present(void){
+  tge_process_resize();
+  tge_begin_frame();
+
+  if(buffer_rows != tge_rows || buffer_cols != tge_cols){
+    screen_resized();
+  }
+
+  if(scroll_pending != 0){
+    unsigned int count = scroll_pending > 0 ? scroll_pending : -scroll_pending;
+
+    if(count <= (unsigned int)(region_bottom() - region_top())){
+      scroll_buffers(scroll_pending);
     } else {
-      cur_x++;
+      damage_all();
+    }
+
+    scroll_pending = 0;
+  }
+
+  repaint_damage();
+
+  if(scan_cells == NULL){
+    select_scan();
+  }
+
+  for(unsigned short y = 0; y < buffer_rows; y++){
+    size_t row = (size_t)y * buffer_cols;
+    unsigned short span_end = 0;
+
+    for(unsigned short x = 0; x < buffer_cols; x++){
+      //find the next span of changed cells
+      if(x >= span_end){
+        x = scan_cells(&front_buffer[row], &back_buffer[row], x, buffer_cols, false);
+
+        if(x == buffer_cols){
+          break;
+        }
+
+        span_end = scan_cells(&front_buffer[row], &back_buffer[row], x + 1, buffer_cols, true);
+      }
+
+      size_t i = row + x;
+
+      const struct cell* cell = &back_buffer[i];
+
+      //the second half of a wide glyph is printed along with the first
+      if(cell->width == 0){
+        front_buffer[i] = *cell;
+        continue;
+      }
+
+      move_cursor(x + 1, y + 1);
+
+      if(cell->width == 1){
+        unsigned int count = run_length(x, y);
+
+        emit_run(cell, x, count);
+
+        for(unsigned int n = 0; n < count; n++){
+          front_buffer[i + n] = *cell;
+        }
+
+        x += count - 1;
+        continue;
+      }
+
+      emit_style(cell);
+      out_utf8(cell->ch);
+      front_buffer[i] = *cell;
+      tge_cursor_x += cell->width;
+
+      if(cell->width == 2 && x + 1 < buffer_cols){
+        front_buffer[i + 1] = back_buffer[i + 1];
+        x++;
+      }
+    }
+  }
+
+  tge_end_frame();
+  tge_flush();
+}
+
+static void sleep_until(unsigned long long deadline){
+  struct timespec ts = {
+    .tv_sec = deadline / NANOSECONDS_PER_SECOND,
+    .tv_nsec = deadline % NANOSECONDS_PER_SECOND
+  };
+
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+}
+
+//sleep until the deadline, waking early to read and dispatch input as it arrives
+static void wait_until(const struct tge_loop* loop, unsigned long long deadline){
+  if(loop->key == NULL || !input_open()){
+    sleep_until(deadline);
+    return;
+  }
+
+  for(;;){
+    unsigned long long now = monotonic_ns();
+
+    if(now >= deadline){
+      return;
+    }
+
+    //rounded up so the wait never ends before the deadline
+    int timeout_ms = (deadline - now + 999999) / 1000000;
+
+    if(tge_wait_input(timeout_ms)){
+      struct tge_key_event event;
+      while(!atomic_load(&stop_requested) && dequeue_key(&event)){
+        loop->key(loop->data, event);
+      }
     }
+  }
+}
+
+static void record_frame_time(unsigned long long ns){
+  if(frame_stats.frames == 0 || ns < frame_stats.min_ns){
+    frame_stats.min_ns = ns;
+  }
+  if(ns > frame_stats.max_ns){
+    frame_stats.max_ns = ns;
+  }
 
-    itr++;
+  frame_stats.total_ns += ns;
+  frame_stats.frames++;
+
+  frame_times[frame_times_next] = ns;
+  frame_times_next = (frame_times_next + 1) % TGE_FRAME_HISTORY;
+}
+
+static int compare_frame_times(const void* a, const void* b){
+  unsigned long long time_a = *(const unsigned long long*)a;
+  unsigned long long time_b = *(const unsigned long long*)b;
+
+  return time_a < time_b ? -1 : time_a > time_b;
+}
+
+struct tge_frame_stats tge_get_frame_stats(void){
+  struct tge_frame_stats stats = frame_stats;
+
+  if(stats.frames == 0){
+    return stats;
   }
+
+  stats.avg_ns = stats.total_ns / stats.frames;
+
+  //percentile of the recent history only, sorted on a copy so the
+  //loop itself never pays for it
+  unsigned int count = stats.frames < TGE_FRAME_HISTORY ? stats.frames : TGE_FRAME_HISTORY;
+  unsigned long long sorted[TGE_FRAME_HISTORY];
+
+  memcpy(sorted, frame_times, count * sizeof(*sorted));
+  qsort(sorted, count, sizeof(*sorted), compare_frame_times);
+
+  stats.p99_ns = sorted[(count * 99 - 1) / 100];
+
+  return stats;
+}
+
+void tge_reset_frame_stats(void){
+  memset(&frame_stats, 0, sizeof(frame_stats));
+  frame_times_next = 0;
+}
+
+void tge_stop(void){
+  atomic_store(&stop_requested, true);
 }
 
+void tge_run(const struct tge_loop* loop){
+  unsigned long long tick_ns = NANOSECONDS_PER_SECOND / (loop->tick_rate > 0 ? loop->tick_rate : TGE_DEFAULT_TICK_RATE);
+  unsigned long long frame_ns = loop->frame_rate > 0 ? NANOSECONDS_PER_SECOND / loop->frame_rate : tick_ns;
+  unsigned int max_ticks = loop->max_ticks_per_frame > 0 ? loop->max_ticks_per_frame : TGE_DEFAULT_MAX_TICKS;
+
+  unsigned long long now = monotonic_ns();
+  unsigned long long next_tick = now;
+  unsigned long long next_frame = now;
+  //update time spent since the last frame, counted towards the next one
+  unsigned long long update_ns = 0;
+
+  while(!atomic_load(&stop_requested)){
+    tge_process_resize();
+
+    now = monotonic_ns();
+    unsigned long long work_start = now;
+
+    unsigned int ticks = 0;
+
+    while(now >= next_tick && ticks < max_ticks && !atomic_load(&stop_requested)){
+      if(loop->update != NULL){
+        loop->update(loop->data);
+      }
+
+      next_tick += tick_ns;
+      ticks++;
+      frame_stats.ticks++;
+    }
+
+    //fell too far behind to catch up. Drop the missed ticks instead of
+    //spiralling, the simulation slows down rather than stalling
+    if(now >= next_tick){
+      unsigned long long missed = (now - next_tick) / tick_ns + 1;
+
+      frame_stats.dropped_ticks += missed;
+      next_tick += missed * tick_ns;
+    }
+
+    if(now >= next_frame && !atomic_load(&stop_requested)){
+      if(loop->render != NULL){
+        //how far the simulation is between the last tick and the next one
+        double alpha = (double)(now + tick_ns - next_tick) / tick_ns;
+
+        loop->render(loop->data, alpha);
+      }
+
+      tge_present();
+
+      unsigned long long work_end = monotonic_ns();
+      record_frame_time(update_ns + work_end - work_start);
+      update_ns = 0;
+
+      next_frame += frame_ns;
+
+      if(next_frame <= work_end){
+        frame_stats.overruns++;
+        next_frame = work_end + frame_ns;
+      }
+    } else if(ticks > 0){
+      update_ns += monotonic_ns() - work_start;
+    }
+
+    wait_until(loop, next_tick < next_frame ? next_tick : next_frame);
+  }
+
+  atomic_store(&stop_requested, false);
+}
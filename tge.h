@@ -2,6 +2,8 @@
 
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <termios.h>
 
@@ -14,6 +16,9 @@ extern "C" {
 #define TGE_CURSOR_OFF "\x1B[?25l"
 #define TGE_CURSOR_ON "\x1B[?25h"
 #define TGE_CURSOR_HOME "\x1B[H"
+#define TGE_STYLE_RESET "\x1B[m"
+#define TGE_SYNC_BEGIN "\x1B[?2026h"
+#define TGE_SYNC_END "\x1B[?2026l"
 
 extern unsigned short tge_rows;
 extern unsigned short tge_cols;
@@ -54,8 +59,84 @@ extern unsigned short tge_cursor_y;
 #define TGE_KEY_LEFT  29
 #define TGE_KEY_RIGHT 30
 #define TGE_KEY_ESC   31
+#define TGE_KEY_0     32
+#define TGE_KEY_1     33
+#define TGE_KEY_2     34
+#define TGE_KEY_3     35
+#define TGE_KEY_4     36
+#define TGE_KEY_5     37
+#define TGE_KEY_6     38
+#define TGE_KEY_7     39
+#define TGE_KEY_8     40
+#define TGE_KEY_9     41
+#define TGE_KEY_ENTER     42
+#define TGE_KEY_TAB       43
+#define TGE_KEY_BACKSPACE 44
+#define TGE_KEY_INSERT    45
+#define TGE_KEY_DELETE    46
+#define TGE_KEY_HOME      47
+#define TGE_KEY_END       48
+#define TGE_KEY_PAGE_UP   49
+#define TGE_KEY_PAGE_DOWN 50
+#define TGE_KEY_F1    51
+#define TGE_KEY_F2    52
+#define TGE_KEY_F3    53
+#define TGE_KEY_F4    54
+#define TGE_KEY_F5    55
+#define TGE_KEY_F6    56
+#define TGE_KEY_F7    57
+#define TGE_KEY_F8    58
+#define TGE_KEY_F9    59
+#define TGE_KEY_F10   60
+#define TGE_KEY_F11   61
+#define TGE_KEY_F12   62
+/*Any other printable character, see tge_key_event.codepoint*/
+#define TGE_KEY_CHAR  63
 
-/*Output all values written to stdout*/
+#define TGE_MOD_SHIFT 1
+#define TGE_MOD_ALT   2
+#define TGE_MOD_CTRL  4
+
+struct tge_key_event {
+  /*One of the TGE_KEY_* macros*/
+  int key;
+  /*TGE_MOD_* flags held with the key*/
+  unsigned int mods;
+  /*The character typed for printable keys, 0 otherwise*/
+  unsigned int codepoint;
+};
+
+#define TGE_DEFAULT_OUTPUT_CAPACITY 65536
+
+struct tge_output_stats {
+  /*Bytes and write calls made by the last tge_flush, including any made early
+    because the output arena filled up before it*/
+  size_t frame_bytes;
+  unsigned int frame_writes;
+  unsigned long long total_bytes;
+  unsigned long long total_writes;
+};
+
+/*Set the size of the output arena all terminal output is collected in.
+  Pending output is flushed first. Return false if allocation fails*/
+bool tge_set_output_capacity(size_t capacity);
+/*Send output to fd instead of stdout, for example a pseudo terminal or
+  /dev/null when benchmarking. Pending output is flushed first*/
+void tge_set_output_fd(int fd);
+/*Receives everything the engine outputs instead of a file descriptor.
+  write gets the contents of the output arena and returns the bytes it took*/
+struct tge_output_backend {
+  size_t (*write)(void* data, const char* bytes, size_t length);
+  void* data;
+};
+
+/*Send output to a backend, such as the headless terminal in tge_vt.h.
+  NULL goes back to writing to the output fd. Pending output is flushed first*/
+void tge_set_output_backend(const struct tge_output_backend* backend);
+/*Get byte and write counts for the last flush and in total*/
+struct tge_output_stats tge_get_output_stats(void);
+/*Output everything collected in the output arena with a single write.
+  Output from stdio is not part of the arena and is not flushed*/
 void tge_flush(void);
 /*Clear the terminal screen*/
 void tge_clear(void);
@@ -93,28 +174,267 @@ struct tge_vec3 {
   int z;
 };
 
+/*A row of a sprite, as an offset and count into its glyphs*/
+struct tge_span {
+  unsigned int start;
+  unsigned int length;
+};
+
+/*A decoded character and the columns it takes on screen, 1 or 2*/
+struct tge_glyph {
+  uint32_t codepoint;
+  uint32_t width;
+};
+
+/*UTF-8 text decoded and measured once so it can be drawn row by row without
+  rescanning. width is the column count of the widest row, height the number
+  of rows*/
+struct tge_sprite {
+  const char* text;
+  unsigned int length;
+  unsigned short width;
+  unsigned short height;
+  const struct tge_span* rows;
+  const struct tge_glyph* glyphs;
+  unsigned int glyph_count;
+};
+
+/*Colours are a kind in the top byte and a value below it*/
+#define TGE_COLOUR_KIND_MASK    0xFF000000u
+#define TGE_COLOUR_KIND_DEFAULT 0x00000000u
+#define TGE_COLOUR_KIND_INDEXED 0x01000000u
+#define TGE_COLOUR_KIND_RGB     0x02000000u
+
+/*The terminal's own foreground or background colour*/
+#define TGE_COLOUR_DEFAULT TGE_COLOUR_KIND_DEFAULT
+/*One of the 256 palette colours. 0-7 are the basic colours, 8-15 their bright versions*/
+#define TGE_COLOUR_INDEXED(n) (TGE_COLOUR_KIND_INDEXED | ((uint32_t)(n) & 0xFF))
+#define TGE_COLOUR_RGB(r, g, b) (TGE_COLOUR_KIND_RGB | ((uint32_t)(r) & 0xFF) << 16 | ((uint32_t)(g) & 0xFF) << 8 | ((uint32_t)(b) & 0xFF))
+
+#define TGE_ATTR_BOLD      1
+#define TGE_ATTR_DIM       2
+#define TGE_ATTR_ITALIC    4
+#define TGE_ATTR_UNDERLINE 8
+#define TGE_ATTR_BLINK     16
+#define TGE_ATTR_REVERSE   32
+#define TGE_ATTR_STRIKE    64
+
+/*Colours a terminal is able to show. Colours beyond the mode are reduced to
+  the nearest one it has when drawn*/
+enum tge_colour_mode {
+  TGE_COLOUR_MODE_16,
+  TGE_COLOUR_MODE_256,
+  TGE_COLOUR_MODE_TRUECOLOR
+};
+
+/*Zero initialised is the terminal's default colours with no attributes*/
+struct tge_style {
+  uint32_t fg;
+  uint32_t bg;
+  uint8_t attrs;
+};
+
 struct tge_game_object {
   struct tge_vec3 pos;
-  char* text;
+  const struct tge_sprite* sprite;
+  struct tge_style style;
 };
 
+/*Set the colour mode used for drawing. tge_init picks truecolor when the
+  COLORTERM environment variable says so, 256 colours otherwise*/
+void tge_set_colour_mode(enum tge_colour_mode mode);
+enum tge_colour_mode tge_get_colour_mode(void);
+/*Build a style from ANSI SGR escapes such as "\x1B[1;31m"*/
+struct tge_style tge_style_from_sgr(const char* sgr);
+
+/*Columns a codepoint takes on screen: 0 for control and combining
+  characters, 2 for wide east asian characters and emoji, 1 otherwise*/
+unsigned int tge_glyph_width(uint32_t codepoint);
+
+/*Build a sprite from newline separated UTF-8 text. The text is copied.
+  Zero width characters are left out since a cell holds one codepoint.
+  On allocation failure, or if the sprite would be wider or taller than
+  65535 cells, the sprite has a height of 0*/
+struct tge_sprite tge_sprite_create(const char* text);
+/*Free memory owned by a sprite made with tge_sprite_create*/
+void tge_sprite_destroy(struct tge_sprite* sprite);
+
 /*Retrieve initial terminal flags to be used in subsequent calls to tcsetattr*/
 void tge_init_term_flags(void);
 /*Initialise terminal. Can be done manually to customise behaviour.
   Take a look at the source and copy the parts that suit your needs. */
 void tge_init(void);
+/*Initialise without a terminal, for rendering to an output backend. The
+  screen size is fixed at rows by cols until tge_rows and tge_cols are set*/
+void tge_init_headless(unsigned short rows, unsigned short cols);
 /*Cleans up terminal. Attempts to reset to state before running program*/
 void tge_clean(void);
 
+/*The terminal holds output between TGE_SYNC_BEGIN and TGE_SYNC_END and
+  shows it at once, so a frame is never seen half drawn*/
+#define TGE_CAP_SYNCHRONIZED_OUTPUT 1
+/*24 bit colour*/
+#define TGE_CAP_TRUECOLOR 2
+/*REP, repeat the last character. Never detected, only set by the program*/
+#define TGE_CAP_REP 4
+/*ECH, erase characters without moving the cursor*/
+#define TGE_CAP_ECH 8
+/*Back colour erase: erasing fills cells with the current background colour
+  rather than the default one. Never detected, only set by the program*/
+#define TGE_CAP_BCE 16
+
+/*How long tge_init waits for the terminal to answer the probe*/
+#define TGE_PROBE_TIMEOUT_MS 150
+
+struct tge_capabilities {
+  /*TGE_CAP_* flags*/
+  unsigned int flags;
+  /*First parameter of the primary device attributes reply, 62 and up for a
+    VT220 or later. 0 if the terminal did not answer*/
+  unsigned int da1_class;
+  /*Terminal type and version from the secondary device attributes reply*/
+  unsigned int da2_type;
+  unsigned int da2_version;
+  /*Name and version reported to XTVERSION, empty if not supported*/
+  char version[64];
+};
+
+/*Ask the terminal what it supports and wait up to timeout_ms for the
+  answers. tge_init calls this already. Keys pressed meanwhile are kept for
+  tge_get_key. Return the TGE_CAP_* flags found.
+  Only synchronized output is reported by the terminal itself. The rest is
+  inferred: ECH from a primary device attributes level of 62 (VT220) or
+  more, and truecolor from COLORTERM being truecolor or 24bit, in which case
+  24 bit colour is switched on. REP cannot be detected and is only used
+  when turned on with tge_set_capabilities*/
+unsigned int tge_probe_capabilities(int timeout_ms);
+struct tge_capabilities tge_get_capabilities(void);
+/*Override the TGE_CAP_* flags, for example when running headless*/
+void tge_set_capabilities(unsigned int flags);
+/*Output between these is shown by the terminal at once if it supports
+  synchronized output. Calls may nest; only the outermost pair counts. A frame
+  with no output in between sends nothing. tge_present does this already*/
+void tge_begin_frame(void);
+void tge_end_frame(void);
+
 typedef void (*tge_resize_callback) (unsigned short rows, unsigned short cols);
-/*Set a callback that is executed whenever terminal window is resized*/
+/*Set a callback that is executed whenever terminal window is resized.
+  It runs from tge_process_resize, never from inside the signal handler*/
 void tge_set_resize_callback(tge_resize_callback callback);
-/*Draw a game object to the screen*/
+/*Apply a pending terminal resize: update tge_rows and tge_cols, reallocate the
+  frame buffers once however many resize signals arrived, and run the resize
+  callback. tge_run, tge_present and tge_wait_input call this already.
+  Return true if the size changed*/
+bool tge_process_resize(void);
+/*Draw a game object into the next frame. Nothing is output until tge_present*/
 void tge_draw_game_object(struct tge_game_object game_object);
-/*Clear a game object from the screen*/
+/*Clear a game object from the next frame. Nothing is output until tge_present*/
 void tge_clear_game_object(struct tge_game_object game_object);
+/*Draw an array of game objects into the next frame. Where objects overlap,
+  the one with the highest pos.z is shown; equal z keeps array order*/
+void tge_draw_scene(const struct tge_game_object* objects, size_t count);
+/*Refers to an object in the engine's registry. 0 is never a valid handle,
+  and a handle stops being valid once its object is destroyed*/
+typedef unsigned int tge_handle;
+
+/*Add an object to the registry. The engine keeps drawing it every frame and,
+  when it changes, repaints only the cells it covered before and after along
+  with whatever lies underneath. The sprite must outlive the object.
+  Registry objects are painted over an empty background, so immediate mode
+  drawing in the same area may be erased. Return 0 if allocation fails*/
+tge_handle tge_object_create(struct tge_game_object object);
+/*Remove an object, revealing what was underneath. Return false for an
+  invalid handle, as do the other tge_object_* functions*/
+bool tge_object_destroy(tge_handle handle);
+bool tge_object_move(tge_handle handle, struct tge_vec3 pos);
+bool tge_object_set_sprite(tge_handle handle, const struct tge_sprite* sprite);
+bool tge_object_set_style(tge_handle handle, struct tge_style style);
+/*The object behind a handle, or NULL. Change it through the functions above
+  so the engine knows what to repaint. The pointer is into the registry and
+  is only valid until the next tge_object_create, which may move it, or
+  until the object is destroyed. Copy the object to keep it longer*/
+const struct tge_game_object* tge_object_get(tge_handle handle);
+/*Repaint an object whose sprite was changed in place*/
+void tge_object_damage(tge_handle handle);
+/*Registry objects are drawn at their position minus the camera. A vertical
+  camera move scrolls the terminal at the next tge_present, so only the
+  rows scrolled in are drawn. A horizontal move redraws everything*/
+void tge_set_camera(int x, int y);
+void tge_get_camera(int* x, int* y);
+/*Limit the rows scrolled by camera moves to top to bottom, inclusive, for
+  example to keep a status line in place. Rows outside are redrawn instead.
+  0 for either means that edge of the screen*/
+void tge_set_scroll_region(unsigned short top, unsigned short bottom);
+/*Repaint damaged registry areas, then output every cell that changed since
+  the last call and flush.
+  Cells that were cleared and redrawn with the same value are not output*/
+void tge_present(void);
+
+#define TGE_DEFAULT_TICK_RATE 60
+#define TGE_DEFAULT_MAX_TICKS 5
+#define TGE_FRAME_HISTORY 1024
+
+struct tge_loop {
+  /*Simulation updates per second. 0 uses TGE_DEFAULT_TICK_RATE*/
+  unsigned int tick_rate;
+  /*Renders per second. 0 renders at the tick rate*/
+  unsigned int frame_rate;
+  /*Most updates run to catch up before a render. Further missed updates are dropped.
+    0 uses TGE_DEFAULT_MAX_TICKS*/
+  unsigned int max_ticks_per_frame;
+  /*Called once per tick with a fixed time step of 1 / tick_rate seconds*/
+  void (*update)(void* data);
+  /*Called once per frame before tge_present. alpha is how far, from 0 to 1,
+    the current time is between the last tick and the next*/
+  void (*render)(void* data, double alpha);
+  /*Optional. Called for each key as soon as it arrives while the loop is waiting.
+    When not set, keys stay queued for tge_get_key*/
+  void (*key)(void* data, struct tge_key_event event);
+  void* data;
+};
+
+struct tge_frame_stats {
+  unsigned long long frames;
+  unsigned long long ticks;
+  /*Frames that finished after the next frame was due*/
+  unsigned long long overruns;
+  unsigned long long dropped_ticks;
+  /*Time spent updating, rendering and presenting per frame, excluding sleep.
+    Updates run between frames count towards the next frame.
+    p99 covers the last TGE_FRAME_HISTORY frames*/
+  unsigned long long min_ns;
+  unsigned long long avg_ns;
+  unsigned long long p99_ns;
+  unsigned long long max_ns;
+  unsigned long long total_ns;
+};
+
+/*Run the game loop until tge_stop is called. Sleeps between ticks and frames*/
+void tge_run(const struct tge_loop* loop);
+/*Make tge_run return after the current tick or frame. Safe to call from any
+  thread. Called while tge_run is not running, the next tge_run returns at once*/
+void tge_stop(void);
+/*Get frame time statistics gathered by tge_run*/
+struct tge_frame_stats tge_get_frame_stats(void);
+/*Reset frame time statistics*/
+void tge_reset_frame_stats(void);
+
+#define TGE_INPUT_BUFFER_SIZE 256
+#define TGE_KEY_QUEUE_SIZE 64
+/*How long an escape sequence cut off by the end of a read waits for the rest
+  before its bytes are taken as separate keys, e.g. a lone ESC press*/
+#define TGE_ESCAPE_TIMEOUT_MS 25
+
+/*Wait up to timeout_ms for input (-1 waits forever, 0 does not wait), then read
+  everything pending with one read and queue the decoded keys. Once stdin
+  reaches end of file or hangs up, and always after tge_init_headless, it
+  is not read and this only waits. Return true if any keys are queued*/
+bool tge_wait_input(int timeout_ms);
+/*Get the next key event. Return false if no key was pressed*/
+bool tge_get_key_event(struct tge_key_event* event);
 /*Get pressed key. Will return int value corresponding to TGE_KEY_* macros
-  Return TGE_KEY_NONE if no key pressed*/
+  Return TGE_KEY_NONE if no key pressed. Queued keys are returned first,
+  otherwise pending input is read without waiting*/
 int tge_get_key(void);
 
 #ifdef __cplusplus
@@ -0,0 +1,353 @@
+//renderer benchmark. Every scene is drawn for a fixed number of frames to a
+//pseudo terminal, /dev/null or the in memory terminal, reporting time, bytes
+//and writes per frame.
+//build with: gcc -O2 -pthread -o tge_bench tge_bench.c tge.c tge_vt.c
+//run with: ./tge_bench [null|pty|vt] [frames] [cols] [rows]
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "tge.h"
+#include "tge_vt.h"
+
+#define DEFAULT_FRAMES 1000
+#define DEFAULT_COLS 200
+#define DEFAULT_ROWS 50
+#define SMALL_SPRITE_COUNT 1000
+#define SPARSE_UPDATES 16
+
+struct scene {
+  const char* name;
+  void (*setup)(void);
+  void (*frame)(unsigned int n);
+  void (*teardown)(void);
+};
+
+//fixed seed so every run draws the same frames
+static unsigned int random_state;
+
+static unsigned int next_random(void){
+  random_state = random_state * 1103515245 + 12345;
+  return random_state >> 16;
+}
+
+static unsigned long long now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//many small sprites, each moving one cell a frame and bouncing off the edges
+
+static struct tge_sprite small_sprite;
+static struct tge_game_object small_objects[SMALL_SPRITE_COUNT];
+static int small_velocity[SMALL_SPRITE_COUNT][2];
+
+static void small_setup(void){
+  small_sprite = tge_sprite_create("<o>\n/ \\");
+
+  for(int i = 0; i < SMALL_SPRITE_COUNT; i++){
+    small_objects[i] = (struct tge_game_object){
+      .pos = { 1 + next_random() % (tge_cols - 2), 1 + next_random() % (tge_rows - 1), i },
+      .sprite = &small_sprite,
+      .style = { .fg = TGE_COLOUR_INDEXED(1 + i % 7) }
+    };
+    small_velocity[i][0] = next_random() % 2 ? 1 : -1;
+    small_velocity[i][1] = next_random() % 2 ? 1 : -1;
+  }
+}
+
+static void small_frame(unsigned int n){
+  (void)n;
+
+  for(int i = 0; i < SMALL_SPRITE_COUNT; i++){
+    tge_clear_game_object(small_objects[i]);
+  }
+
+  for(int i = 0; i < SMALL_SPRITE_COUNT; i++){
+    struct tge_vec3* pos = &small_objects[i].pos;
+
+    if(pos->x + small_velocity[i][0] < 1 || pos->x + small_velocity[i][0] > tge_cols - 2){
+      small_velocity[i][0] = -small_velocity[i][0];
+    }
+    if(pos->y + small_velocity[i][1] < 1 || pos->y + small_velocity[i][1] > tge_rows - 1){
+      small_velocity[i][1] = -small_velocity[i][1];
+    }
+
+    pos->x += small_velocity[i][0];
+    pos->y += small_velocity[i][1];
+
+    tge_draw_game_object(small_objects[i]);
+  }
+}
+
+static void small_teardown(void){
+  tge_sprite_destroy(&small_sprite);
+}
+
+//a screen of text moving up one row a frame, the worst case for a cell diff
+
+static struct tge_sprite scroll_sprite;
+
+static void scroll_setup(void){
+  size_t size = (size_t)tge_rows * 2 * (tge_cols + 1);
+  char* text = malloc(size + 1);
+
+  if(text == NULL){
+    return;
+  }
+
+  char* itr = text;
+
+  for(int y = 0; y < tge_rows * 2; y++){
+    for(int x = 0; x < tge_cols; x++){
+      unsigned int r = next_random() % 32;
+      *itr++ = r < 6 ? ' ' : 'a' + r % 26;
+    }
+
+    *itr++ = '\n';
+  }
+
+  *itr = '\0';
+
+  scroll_sprite = tge_sprite_create(text);
+  free(text);
+}
+
+static void scroll_frame(unsigned int n){
+  struct tge_game_object page = {
+    .pos = { 1, 1 - (int)(n % tge_rows), 0 },
+    .sprite = &scroll_sprite
+  };
+
+  tge_draw_game_object(page);
+}
+
+static void scroll_teardown(void){
+  tge_sprite_destroy(&scroll_sprite);
+}
+
+//a static screen where only a few cells change each frame
+
+static struct tge_sprite sparse_background;
+static struct tge_sprite sparse_sprite;
+static struct tge_game_object sparse_objects[SPARSE_UPDATES];
+
+static void sparse_setup(void){
+  size_t size = (size_t)tge_rows * (tge_cols + 1);
+  char* text = malloc(size + 1);
+
+  if(text == NULL){
+    return;
+  }
+
+  for(size_t i = 0; i < size; i++){
+    text[i] = i % (tge_cols + 1) == (size_t)tge_cols ? '\n' : '.';
+  }
+
+  text[size] = '\0';
+
+  sparse_background = tge_sprite_create(text);
+  sparse_sprite = tge_sprite_create("*");
+  free(text);
+
+  tge_draw_game_object((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &sparse_background });
+
+  for(int i = 0; i < SPARSE_UPDATES; i++){
+    sparse_objects[i] = (struct tge_game_object){ .pos = { 1, 1, 1 }, .sprite = &sparse_sprite };
+  }
+}
+
+static void sparse_frame(unsigned int n){
+  (void)n;
+
+  struct tge_game_object background = { .pos = { 1, 1, 0 }, .sprite = &sparse_background };
+
+  //put the background back under the previous frame's updates
+  for(int i = 0; i < SPARSE_UPDATES; i++){
+    tge_clear_game_object(sparse_objects[i]);
+  }
+  tge_draw_game_object(background);
+
+  for(int i = 0; i < SPARSE_UPDATES; i++){
+    sparse_objects[i].pos.x = 1 + next_random() % tge_cols;
+    sparse_objects[i].pos.y = 1 + next_random() % tge_rows;
+    tge_draw_game_object(sparse_objects[i]);
+  }
+}
+
+static void sparse_teardown(void){
+  tge_sprite_destroy(&sparse_background);
+  tge_sprite_destroy(&sparse_sprite);
+}
+
+//the sparse background left as it is, so a frame is only the diff
+static void idle_frame(unsigned int n){
+  (void)n;
+}
+
+static const struct scene scenes[] = {
+  { "small sprites", small_setup, small_frame, small_teardown },
+  { "full screen scroll", scroll_setup, scroll_frame, scroll_teardown },
+  { "sparse updates", sparse_setup, sparse_frame, sparse_teardown },
+  { "idle screen", sparse_setup, idle_frame, sparse_teardown }
+};
+
+//reading the master side keeps the pty from filling up and blocking writes
+static void* drain_pty(void* arg){
+  int master = *(int*)arg;
+  char buf[65536];
+
+  while(read(master, buf, sizeof(buf)) > 0);
+
+  return NULL;
+}
+
+//covers the whole screen, for clearing between scenes
+static struct tge_sprite screen_sprite;
+
+static void run_scene(const struct scene* scene, unsigned int frames){
+  random_state = 1;
+
+  scene->setup();
+
+  //the first frame paints everything and is not counted
+  tge_clear();
+  tge_present();
+
+  struct tge_output_stats before = tge_get_output_stats();
+  unsigned long long start = now_ns();
+
+  for(unsigned int n = 0; n < frames; n++){
+    scene->frame(n);
+    tge_present();
+  }
+
+  unsigned long long elapsed = now_ns() - start;
+  struct tge_output_stats after = tge_get_output_stats();
+
+  printf("%-20s %10.0f ns/frame %10.0f bytes/frame %6.2f writes/frame\n",
+    scene->name,
+    (double)elapsed / frames,
+    (double)(after.total_bytes - before.total_bytes) / frames,
+    (double)(after.total_writes - before.total_writes) / frames);
+
+  scene->teardown();
+
+  //leave a blank frame for the next scene
+  tge_clear_game_object((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &screen_sprite });
+}
+
+int main(int argc, char** argv){
+  const char* target = argc > 1 ? argv[1] : "null";
+  unsigned int frames = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_FRAMES;
+
+  tge_cols = argc > 3 ? strtoul(argv[3], NULL, 10) : DEFAULT_COLS;
+  tge_rows = argc > 4 ? strtoul(argv[4], NULL, 10) : DEFAULT_ROWS;
+
+  if(frames == 0 || tge_cols < 4 || tge_rows < 4){
+    fprintf(stderr, "usage: %s [null|pty|vt] [frames] [cols] [rows]\n", argv[0]);
+    return 1;
+  }
+
+  int master = -1;
+  int fd = -1;
+  pthread_t drain;
+  struct tge_vt vt = { 0 };
+
+  if(strcmp(target, "vt") == 0){
+    if(!tge_vt_init(&vt, tge_rows, tge_cols)){
+      return 1;
+    }
+
+    struct tge_output_backend backend = tge_vt_backend(&vt);
+    tge_set_output_backend(&backend);
+    //the in memory terminal understands repeat and erase characters
+    tge_set_capabilities(TGE_CAP_REP | TGE_CAP_ECH);
+  } else if(strcmp(target, "pty") == 0){
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+
+    if(master == -1 || grantpt(master) == -1 || unlockpt(master) == -1){
+      perror("posix_openpt");
+      return 1;
+    }
+
+    fd = open(ptsname(master), O_WRONLY | O_NOCTTY);
+
+    if(fd == -1){
+      perror("open pty");
+      return 1;
+    }
+
+    //raw so the line discipline passes output through untouched
+    struct termios flags;
+    tcgetattr(fd, &flags);
+    cfmakeraw(&flags);
+    tcsetattr(fd, TCSANOW, &flags);
+
+    struct winsize size = { .ws_row = tge_rows, .ws_col = tge_cols };
+    ioctl(fd, TIOCSWINSZ, &size);
+
+    pthread_create(&drain, NULL, drain_pty, &master);
+  } else {
+    fd = open("/dev/null", O_WRONLY);
+
+    if(fd == -1){
+      perror("open /dev/null");
+      return 1;
+    }
+  }
+
+  if(fd != -1){
+    tge_set_output_fd(fd);
+  }
+
+  char* blank = malloc((size_t)tge_rows * (tge_cols + 1) + 1);
+
+  if(blank == NULL){
+    return 1;
+  }
+
+  for(size_t i = 0; i < (size_t)tge_rows * (tge_cols + 1); i++){
+    blank[i] = i % (tge_cols + 1) == (size_t)tge_cols ? '\n' : ' ';
+  }
+
+  blank[(size_t)tge_rows * (tge_cols + 1)] = '\0';
+  screen_sprite = tge_sprite_create(blank);
+  free(blank);
+
+  //allocates the frame buffers so scene setup can draw into them
+  tge_present();
+
+  printf("%s, %u frames of %ux%u\n", target, frames, tge_cols, tge_rows);
+
+  for(size_t i = 0; i < sizeof(scenes) / sizeof(scenes[0]); i++){
+    run_scene(&scenes[i], frames);
+  }
+
+  tge_sprite_destroy(&screen_sprite);
+  tge_set_output_backend(NULL);
+  tge_set_output_fd(STDOUT_FILENO);
+  tge_vt_destroy(&vt);
+
+  if(fd != -1){
+    close(fd);
+  }
+
+  if(master != -1){
+    //closing the slave makes the drain thread's read fail
+    pthread_join(drain, NULL);
+    close(master);
+  }
+
+  return 0;
+}
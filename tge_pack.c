@@ -0,0 +1,343 @@
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "tge_pack.h"
+
+//a section of count elements of size bytes at offset fits in the file
+static bool section_valid(const struct tge_pack* pack, uint32_t offset, uint64_t count, size_t size){
+  return offset % 4 == 0 && (uint64_t)offset + count * size <= pack->size;
+}
+
+//glyphs are written to the terminal as they are, so only characters
+//tge_sprite_create would keep are allowed, with the width it would give them.
+//Anything else could be a control character injecting escape sequences
+static bool glyph_valid(const struct tge_glyph* glyph){
+  uint32_t c = glyph->codepoint;
+
+  if(c < 0x20 || (c >= 0x7F && c < 0xA0) || (c >= 0xD800 && c <= 0xDFFF) || c > 0x10FFFF){
+    return false;
+  }
+
+  return glyph->width != 0 && glyph->width == tge_glyph_width(c);
+}
+
+//check every record against the sections it points into, so drawing a
+//sprite from a damaged file can never read outside the mapping
+static bool pack_validate(struct tge_pack* pack){
+  if(pack->size < sizeof(struct tge_pack_header)){
+    return false;
+  }
+
+  const struct tge_pack_header* header = pack->map;
+
+  if(memcmp(header->magic, TGE_PACK_MAGIC, sizeof(TGE_PACK_MAGIC)) != 0 || header->version != TGE_PACK_VERSION){
+    return false;
+  }
+
+  if(!section_valid(pack, header->index_offset, header->sprite_count, sizeof(struct tge_pack_index_entry)) ||
+     !section_valid(pack, header->sprites_offset, header->sprite_count, sizeof(struct tge_pack_sprite)) ||
+     !section_valid(pack, header->spans_offset, header->span_count, sizeof(struct tge_span)) ||
+     !section_valid(pack, header->glyphs_offset, header->glyph_count, sizeof(struct tge_glyph)) ||
+     !section_valid(pack, header->strings_offset, header->strings_size, 1)){
+    return false;
+  }
+
+  const char* strings = (const char*)pack->map + header->strings_offset;
+
+  //every string in the blob ends in a NUL, so the last byte must be one
+  if(header->strings_size > 0 && strings[header->strings_size - 1] != '\0'){
+    return false;
+  }
+
+  const struct tge_pack_index_entry* index = (const void*)((const char*)pack->map + header->index_offset);
+
+  for(uint32_t i = 0; i < header->sprite_count; i++){
+    if(index[i].sprite >= header->sprite_count || (i > 0 && index[i - 1].key >= index[i].key)){
+      return false;
+    }
+  }
+
+  const struct tge_pack_sprite* sprites = (const void*)((const char*)pack->map + header->sprites_offset);
+  const struct tge_span* spans = (const void*)((const char*)pack->map + header->spans_offset);
+  const struct tge_glyph* glyphs = (const void*)((const char*)pack->map + header->glyphs_offset);
+
+  for(uint32_t i = 0; i < header->glyph_count; i++){
+    if(!glyph_valid(&glyphs[i])){
+      return false;
+    }
+  }
+
+  for(uint32_t i = 0; i < header->sprite_count; i++){
+    const struct tge_pack_sprite* sprite = &sprites[i];
+
+    if((uint64_t)sprite->text_offset + sprite->length >= header->strings_size ||
+       (uint64_t)sprite->first_span + sprite->height > header->span_count ||
+       (uint64_t)sprite->first_glyph + sprite->glyph_count > header->glyph_count){
+      return false;
+    }
+    if(sprite->colour_offset != TGE_PACK_NO_COLOUR && sprite->colour_offset >= header->strings_size){
+      return false;
+    }
+
+    for(uint32_t row = 0; row < sprite->height; row++){
+      const struct tge_span* span = &spans[sprite->first_span + row];
+
+      if((uint64_t)span->start + span->length > sprite->glyph_count){
+        return false;
+      }
+
+      //drawing relies on glyph widths adding up to at most the sprite width
+      uint32_t width = 0;
+
+      for(uint32_t glyph = 0; glyph < span->length; glyph++){
+        width += glyphs[sprite->first_glyph + span->start + glyph].width;
+      }
+
+      if(width > sprite->width){
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
+bool tge_pack_open(struct tge_pack* pack, const char* path){
+  *pack = (struct tge_pack){ 0 };
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  if(fd == -1){
+    return false;
+  }
+
+  struct stat info;
+
+  if(fstat(fd, &info) == -1 || info.st_size <= 0){
+    close(fd);
+    return false;
+  }
+
+  //shared and read only, so every process using the pack shares its pages
+  void* map = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if(map == MAP_FAILED){
+    return false;
+  }
+
+  pack->map = map;
+  pack->size = info.st_size;
+
+  if(!pack_validate(pack)){
+    tge_pack_close(pack);
+    return false;
+  }
+
+  const struct tge_pack_header* header = map;
+  const char* base = map;
+  const struct tge_pack_sprite* sprites = (const void*)(base + header->sprites_offset);
+  const struct tge_span* spans = (const void*)(base + header->spans_offset);
+  const struct tge_glyph* glyphs = (const void*)(base + header->glyphs_offset);
+  const char* strings = base + header->strings_offset;
+
+  pack->assets = malloc(header->sprite_count * sizeof(struct tge_pack_asset) + 1);
+
+  if(pack->assets == NULL){
+    tge_pack_close(pack);
+    return false;
+  }
+
+  for(uint32_t i = 0; i < header->sprite_count; i++){
+    const struct tge_pack_sprite* sprite = &sprites[i];
+
+    pack->assets[i] = (struct tge_pack_asset){
+      .sprite = {
+        .text = strings + sprite->text_offset,
+        .length = sprite->length,
+        .width = sprite->width,
+        .height = sprite->height,
+        .rows = &spans[sprite->first_span],
+        .glyphs = &glyphs[sprite->first_glyph],
+        .glyph_count = sprite->glyph_count
+      },
+      .colour = sprite->colour_offset == TGE_PACK_NO_COLOUR ? NULL : strings + sprite->colour_offset
+    };
+  }
+
+  pack->count = header->sprite_count;
+  pack->index = (const void*)(base + header->index_offset);
+
+  return true;
+}
+
+void tge_pack_close(struct tge_pack* pack){
+  if(pack->map != NULL){
+    munmap(pack->map, pack->size);
+  }
+
+  free(pack->assets);
+
+  *pack = (struct tge_pack){ 0 };
+}
+
+const struct tge_pack_asset* tge_pack_find(const struct tge_pack* pack, unsigned int key){
+  unsigned int low = 0;
+  unsigned int high = pack->count;
+
+  while(low < high){
+    unsigned int middle = low + (high - low) / 2;
+    uint32_t middle_key = pack->index[middle].key;
+
+    if(middle_key == key){
+      return &pack->assets[pack->index[middle].sprite];
+    } else if(middle_key < key){
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  return NULL;
+}
+
+static int compare_index_entries(const void* a, const void* b){
+  uint32_t key_a = ((const struct tge_pack_index_entry*)a)->key;
+  uint32_t key_b = ((const struct tge_pack_index_entry*)b)->key;
+
+  return key_a < key_b ? -1 : key_a > key_b;
+}
+
+static inline uint32_t align4(uint32_t n){
+  return (n + 3) & ~3u;
+}
+
+//pad the file up to offset, then write size bytes of data there
+static bool write_section(FILE* file, uint32_t* position, uint32_t offset, const void* data, size_t size){
+  static const char padding[4] = { 0 };
+
+  if(offset - *position > sizeof(padding) || fwrite(padding, 1, offset - *position, file) != offset - *position){
+    return false;
+  }
+  if(size > 0 && fwrite(data, 1, size, file) != size){
+    return false;
+  }
+
+  *position = offset + size;
+
+  return true;
+}
+
+bool tge_pack_write(const char* path, const unsigned int* keys, const struct tge_sprite* sprites, const char* const* colours, unsigned int count){
+  struct tge_pack_index_entry* index = malloc(count * sizeof(*index) + 1);
+  struct tge_pack_sprite* records = malloc(count * sizeof(*records) + 1);
+
+  if(index == NULL || records == NULL){
+    free(index);
+    free(records);
+    return false;
+  }
+
+  uint32_t span_count = 0;
+  uint32_t glyph_count = 0;
+  uint32_t strings_size = 0;
+
+  for(unsigned int i = 0; i < count; i++){
+    const char* colour = colours != NULL ? colours[i] : NULL;
+
+    index[i] = (struct tge_pack_index_entry){ .key = keys[i], .sprite = i };
+
+    records[i] = (struct tge_pack_sprite){
+      .text_offset = strings_size,
+      .length = sprites[i].length,
+      .width = sprites[i].width,
+      .height = sprites[i].height,
+      .first_span = span_count,
+      .first_glyph = glyph_count,
+      .glyph_count = sprites[i].glyph_count,
+      .colour_offset = TGE_PACK_NO_COLOUR
+    };
+
+    strings_size += sprites[i].length + 1;
+    span_count += sprites[i].height;
+    glyph_count += sprites[i].glyph_count;
+
+    if(colour != NULL){
+      records[i].colour_offset = strings_size;
+      strings_size += strlen(colour) + 1;
+    }
+  }
+
+  qsort(index, count, sizeof(*index), compare_index_entries);
+
+  bool valid = true;
+
+  for(unsigned int i = 1; i < count && valid; i++){
+    valid = index[i - 1].key != index[i].key;
+  }
+
+  struct tge_pack_header header = {
+    .magic = TGE_PACK_MAGIC,
+    .version = TGE_PACK_VERSION,
+    .sprite_count = count,
+    .span_count = span_count,
+    .glyph_count = glyph_count,
+    .strings_size = strings_size
+  };
+
+  header.index_offset = align4(sizeof(header));
+  header.sprites_offset = align4(header.index_offset + count * sizeof(*index));
+  header.spans_offset = align4(header.sprites_offset + count * sizeof(*records));
+  header.glyphs_offset = align4(header.spans_offset + span_count * sizeof(struct tge_span));
+  header.strings_offset = align4(header.glyphs_offset + glyph_count * sizeof(struct tge_glyph));
+
+  FILE* file = valid ? fopen(path, "wb") : NULL;
+
+  if(file == NULL){
+    free(index);
+    free(records);
+    return false;
+  }
+
+  uint32_t position = 0;
+
+  valid = write_section(file, &position, 0, &header, sizeof(header));
+  valid = valid && write_section(file, &position, header.index_offset, index, count * sizeof(*index));
+  valid = valid && write_section(file, &position, header.sprites_offset, records, count * sizeof(*records));
+
+  for(unsigned int i = 0; i < count && valid; i++){
+    uint32_t offset = i == 0 ? header.spans_offset : position;
+    valid = write_section(file, &position, offset, sprites[i].rows, sprites[i].height * sizeof(struct tge_span));
+  }
+
+  for(unsigned int i = 0; i < count && valid; i++){
+    uint32_t offset = i == 0 ? header.glyphs_offset : position;
+    valid = write_section(file, &position, offset, sprites[i].glyphs, sprites[i].glyph_count * sizeof(struct tge_glyph));
+  }
+
+  for(unsigned int i = 0; i < count && valid; i++){
+    const char* colour = colours != NULL ? colours[i] : NULL;
+    uint32_t offset = i == 0 ? header.strings_offset : position;
+
+    valid = write_section(file, &position, offset, sprites[i].text, sprites[i].length);
+    valid = valid && write_section(file, &position, position, "", 1);
+
+    if(valid && colour != NULL){
+      valid = write_section(file, &position, position, colour, strlen(colour) + 1);
+    }
+  }
+
+  valid = fclose(file) == 0 && valid;
+
+  free(index);
+  free(records);
+
+  return valid;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tge.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TGE_PACK_MAGIC "TGEPACK"
+#define TGE_PACK_VERSION 2
+/*Stored in place of a colour offset when a sprite has no colour*/
+#define TGE_PACK_NO_COLOUR UINT32_MAX
+
+/*On disk layout, all integers in native byte order. The header is followed
+  by the index, sprite records, row spans, decoded glyphs and a blob of NUL
+  terminated text and colour strings, each section at the offset the header
+  gives*/
+struct tge_pack_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t sprite_count;
+  uint32_t span_count;
+  uint32_t glyph_count;
+  uint32_t index_offset;
+  uint32_t sprites_offset;
+  uint32_t spans_offset;
+  uint32_t glyphs_offset;
+  uint32_t strings_offset;
+  uint32_t strings_size;
+};
+
+/*Sorted by key so lookups can binary search the mapped file*/
+struct tge_pack_index_entry {
+  uint32_t key;
+  uint32_t sprite;
+};
+
+struct tge_pack_sprite {
+  uint32_t text_offset;
+  uint32_t length;
+  uint16_t width;
+  uint16_t height;
+  uint32_t first_span;
+  uint32_t first_glyph;
+  uint32_t glyph_count;
+  uint32_t colour_offset;
+};
+
+/*A sprite as found in a pack. Text, spans, glyphs and colour point into the
+  mapping*/
+struct tge_pack_asset {
+  struct tge_sprite sprite;
+  /*ANSI colour escape string, or NULL*/
+  const char* colour;
+};
+
+struct tge_pack {
+  void* map;
+  size_t size;
+  unsigned int count;
+  const struct tge_pack_index_entry* index;
+  struct tge_pack_asset* assets;
+};
+
+/*Map a pack file. Sprites are used in place, nothing is parsed or copied
+  beyond a small header per sprite. Return false if the file cannot be
+  mapped or is not a valid pack of this version*/
+bool tge_pack_open(struct tge_pack* pack, const char* path);
+/*Unmap a pack. Sprites from it must no longer be used*/
+void tge_pack_close(struct tge_pack* pack);
+/*Find the asset stored under key. Return NULL if there is none*/
+const struct tge_pack_asset* tge_pack_find(const struct tge_pack* pack, unsigned int key);
+/*Write count sprites to a pack file, stored under keys. colours may be NULL,
+  as may any of its entries. Return false on failure or duplicate keys*/
+bool tge_pack_write(const char* path, const unsigned int* keys, const struct tge_sprite* sprites, const char* const* colours, unsigned int count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "tge.c"
+#include "tge_pack.c"
+#include "tge_pack.h"
+#include "test.h"
+
+#define PACK_PATH "/tmp/tge_pack_test.pack"
+
+void test_round_trip(){
+  puts("testing write then open");
+  struct tge_sprite sprites[3] = {
+    tge_sprite_create("\u250C\u2500\u2500\u2510\n\u2502\u732B\u2502"),
+    tge_sprite_create("#####"),
+    tge_sprite_create("a\nbcd\n\nef\n")
+  };
+  unsigned int keys[3] = { 42, 7, 1000 };
+  const char* colours[3] = { "\x1B[1;31m", NULL, "\x1B[32m" };
+
+  expect_int(tge_pack_write(PACK_PATH, keys, sprites, colours, 3), 1, "pack written");
+
+  struct tge_pack pack;
+
+  expect_int(tge_pack_open(&pack, PACK_PATH), 1, "pack opened");
+  expect_uint(pack.count, 3, "sprite count");
+
+  const struct tge_pack_asset* asset = tge_pack_find(&pack, 1000);
+
+  expect_int(asset != NULL, 1, "1000 found");
+  expect_uint(asset->sprite.width, 3, "width");
+  expect_uint(asset->sprite.height, 4, "height");
+  expect_uint(asset->sprite.rows[1].length, 3, "row length");
+  expect_uint(asset->sprite.glyphs[asset->sprite.rows[3].start].codepoint, 'e', "row glyph");
+  expect_int(strcmp(asset->colour, "\x1B[32m"), 0, "colour");
+  expect_int(asset->sprite.text >= (const char*)pack.map && asset->sprite.text < (const char*)pack.map + pack.size, 1, "text used in place");
+
+  asset = tge_pack_find(&pack, 7);
+
+  expect_int(asset != NULL && asset->colour == NULL, 1, "7 found without colour");
+  expect_uint(asset->sprite.length, 5, "length");
+
+  asset = tge_pack_find(&pack, 42);
+
+  expect_int(asset != NULL, 1, "42 found");
+  expect_uint(asset->sprite.width, 4, "wide glyph width");
+  expect_uint(asset->sprite.glyphs[asset->sprite.rows[1].start + 1].codepoint, 0x732B, "wide glyph");
+  expect_uint(asset->sprite.glyphs[asset->sprite.rows[1].start + 1].width, 2, "wide glyph columns");
+  expect_int(tge_pack_find(&pack, 8) == NULL, 1, "8 not stored, 8 not found");
+
+  tge_pack_close(&pack);
+
+  for(int i = 0; i < 3; i++){
+    tge_sprite_destroy(&sprites[i]);
+  }
+}
+
+void test_invalid(){
+  puts("testing invalid packs are rejected");
+  struct tge_sprite sprite = tge_sprite_create("abc");
+  unsigned int keys[2] = { 1, 1 };
+  struct tge_sprite sprites[2] = { sprite, sprite };
+  struct tge_pack pack;
+
+  expect_int(tge_pack_write(PACK_PATH, keys, sprites, NULL, 2), 0, "duplicate keys rejected");
+
+  expect_int(tge_pack_write(PACK_PATH, keys, sprites, NULL, 1), 1, "pack written");
+
+  //point the first sprite's text past the end of the string blob
+  FILE* file = fopen(PACK_PATH, "r+b");
+  struct tge_pack_header header;
+  fread(&header, sizeof(header), 1, file);
+  struct tge_pack_sprite record;
+  fseek(file, header.sprites_offset, SEEK_SET);
+  fread(&record, sizeof(record), 1, file);
+  record.text_offset = header.strings_size;
+  fseek(file, header.sprites_offset, SEEK_SET);
+  fwrite(&record, sizeof(record), 1, file);
+  fclose(file);
+
+  expect_int(tge_pack_open(&pack, PACK_PATH), 0, "out of bounds text rejected");
+
+  //glyphs that would write escape sequences, or claim the wrong width
+  struct tge_glyph bad_glyphs[] = {
+    { 0x1B, 1 }, { 0x9B, 1 }, { 0xD800, 1 }, { 0x110000, 1 }, { 'a', 2 }, { 0x732B, 1 }, { 0x301, 0 }
+  };
+  unsigned int rejected = 0;
+
+  for(size_t i = 0; i < sizeof(bad_glyphs) / sizeof(bad_glyphs[0]); i++){
+    tge_pack_write(PACK_PATH, keys, sprites, NULL, 1);
+
+    file = fopen(PACK_PATH, "r+b");
+    fread(&header, sizeof(header), 1, file);
+    fseek(file, header.glyphs_offset + sizeof(struct tge_glyph), SEEK_SET);
+    fwrite(&bad_glyphs[i], sizeof(struct tge_glyph), 1, file);
+    fclose(file);
+
+    if(!tge_pack_open(&pack, PACK_PATH)){
+      rejected++;
+    } else {
+      tge_pack_close(&pack);
+    }
+  }
+
+  expect_uint(rejected, sizeof(bad_glyphs) / sizeof(bad_glyphs[0]), "control characters and wrong widths rejected");
+
+  struct tge_glyph good_glyph = { 0xE9, 1 };
+
+  tge_pack_write(PACK_PATH, keys, sprites, NULL, 1);
+  file = fopen(PACK_PATH, "r+b");
+  fread(&header, sizeof(header), 1, file);
+  fseek(file, header.glyphs_offset + sizeof(struct tge_glyph), SEEK_SET);
+  fwrite(&good_glyph, sizeof(struct tge_glyph), 1, file);
+  fclose(file);
+
+  expect_int(tge_pack_open(&pack, PACK_PATH), 1, "valid replacement glyph accepted");
+  tge_pack_close(&pack);
+
+  file = fopen(PACK_PATH, "wb");
+  fputs("not a pack", file);
+  fclose(file);
+
+  expect_int(tge_pack_open(&pack, PACK_PATH), 0, "wrong magic rejected");
+  expect_int(tge_pack_open(&pack, "/nonexistent/tge.pack"), 0, "missing file rejected");
+
+  remove(PACK_PATH);
+  tge_sprite_destroy(&sprite);
+}
+
+int main(){
+  test_round_trip();
+  test_invalid();
+
+  return 0;
+}
@@ -0,0 +1,707 @@
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <malloc.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//lets a test make an allocation in the engine fail, -1 never fails
+static int allocations_until_failure = -1;
+//makes reallocations move their block, as they are free to
+static bool reallocations_move;
+
+static void* failing_realloc(void* pointer, size_t size){
+  if(allocations_until_failure >= 0 && allocations_until_failure-- == 0){
+    return NULL;
+  }
+
+  if(!reallocations_move || pointer == NULL){
+    return realloc(pointer, size);
+  }
+
+  void* moved = malloc(size);
+  size_t old_size = malloc_usable_size(pointer);
+
+  if(moved != NULL){
+    memcpy(moved, pointer, old_size < size ? old_size : size);
+    free(pointer);
+  }
+
+  return moved;
+}
+
+#define realloc(pointer, size) failing_realloc(pointer, size)
+#include "tge.c"
+#undef realloc
+#include "test.h"
+
+void test_sprite_limits(){
+  puts("testing sprite size limits");
+  char* text = malloc(UINT16_MAX + 2);
+
+  memset(text, 'x', UINT16_MAX);
+  text[UINT16_MAX] = '\0';
+
+  struct tge_sprite sprite = tge_sprite_create(text);
+
+  expect_uint(sprite.width, UINT16_MAX, "widest sprite");
+  tge_sprite_destroy(&sprite);
+
+  text[UINT16_MAX] = 'x';
+  text[UINT16_MAX + 1] = '\0';
+  sprite = tge_sprite_create(text);
+
+  expect_uint(sprite.height, 0, "wider sprite rejected");
+
+  memset(text, '\n', UINT16_MAX + 1);
+  sprite = tge_sprite_create(text);
+
+  expect_uint(sprite.height, 0, "taller sprite rejected");
+
+  free(text);
+}
+
+static unsigned int ticks_left;
+
+static void count_down(void* data){
+  (void)data;
+
+  if(--ticks_left == 0){
+    tge_stop();
+  }
+}
+
+static void ignore_key(void* data, struct tge_key_event event){
+  (void)data;
+  (void)event;
+}
+
+static double cpu_seconds(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//stdin replaced by a pipe holding text, closed for writing if closed is set
+static int pipe_stdin(const char* text, bool closed){
+  int fds[2];
+  int saved = dup(STDIN_FILENO);
+
+  if(pipe(fds) != 0){
+    return saved;
+  }
+
+  ssize_t ignored = write(fds[1], text, strlen(text));
+  (void)ignored;
+
+  //never block, so a test fails rather than hangs if it reads too much
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  dup2(fds[0], STDIN_FILENO);
+  close(fds[0]);
+
+  if(closed){
+    close(fds[1]);
+  }
+
+  return saved;
+}
+
+void test_closed_input(){
+  puts("testing closed input");
+  int null_fd = open("/dev/null", O_WRONLY);
+  int saved = pipe_stdin("a", true);
+
+  tge_set_output_fd(null_fd);
+
+  expect_int(tge_wait_input(0), 1, "key read before end of file");
+  expect_int(tge_get_key(), TGE_KEY_A, "key");
+  tge_wait_input(0);
+  expect_int(input_closed, 1, "end of file seen");
+
+  //waiting for keys on a closed stdin must sleep rather than spin
+  struct tge_loop loop = { .tick_rate = 100, .update = count_down, .key = ignore_key };
+  double start = cpu_seconds();
+
+  ticks_left = 20;
+  tge_run(&loop);
+
+  expect_int(cpu_seconds() - start < 0.05, 1, "idle loop sleeps");
+
+  dup2(saved, STDIN_FILENO);
+  close(saved);
+
+  //only stdin being headless may keep it from being read
+  input_closed = false;
+  saved = pipe_stdin("b", false);
+  tge_init_headless(0, 0);
+
+  expect_int(tge_wait_input(0), 0, "headless does not read stdin");
+
+  char byte = 0;
+  expect_int(read(STDIN_FILENO, &byte, 1) == 1 && byte == 'b', 1, "input left in place");
+
+  tge_clean();
+  dup2(saved, STDIN_FILENO);
+  close(saved);
+  tge_set_output_fd(STDOUT_FILENO);
+  close(null_fd);
+}
+
+static unsigned int resizes;
+
+static void count_resize(unsigned short rows, unsigned short cols){
+  (void)rows;
+  (void)cols;
+
+  resizes++;
+}
+
+void test_resize(){
+  puts("testing resize coalescing");
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+  grantpt(master);
+  unlockpt(master);
+
+  int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  int saved = dup(STDOUT_FILENO);
+
+  //the size is read from stdout, so make it a terminal of a known size
+  fflush(stdout);
+  dup2(slave, STDOUT_FILENO);
+  tge_set_output_fd(master);
+
+  struct winsize size = { .ws_row = 30, .ws_col = 90 };
+  ioctl(slave, TIOCSWINSZ, &size);
+
+  pipe(resize_pipe);
+  for(int i = 0; i < 2; i++){
+    fcntl(resize_pipe[i], F_SETFL, O_NONBLOCK);
+  }
+
+  tge_set_resize_callback(count_resize);
+  handle_terminal_resize(SIGWINCH);
+  handle_terminal_resize(SIGWINCH);
+
+  char byte;
+  bool woken = poll(&(struct pollfd){ .fd = resize_pipe[0], .events = POLLIN }, 1, 0) == 1;
+  bool changed = tge_process_resize();
+  bool changed_again = tge_process_resize();
+  bool drained = read(resize_pipe[0], &byte, 1) == -1;
+  unsigned short rows = tge_rows;
+  unsigned short cols = tge_cols;
+  bool cursor_unknown = tge_cursor_x == 0 && tge_cursor_y == 0;
+
+  //restores terminal flags on stdout, so before it is the real one again
+  tge_set_resize_callback(NULL);
+  tge_clean();
+
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+
+  expect_int(woken, 1, "signal wakes the pipe");
+  expect_int(changed && !changed_again, 1, "two signals make one resize");
+  expect_uint(resizes, 1, "callback run once");
+  expect_uint(rows * 1000 + cols, 30090, "new size");
+  expect_int(drained, 1, "wakeups drained");
+  expect_int(cursor_unknown, 1, "cursor position unknown after a resize");
+
+  tge_set_output_fd(STDOUT_FILENO);
+  close(slave);
+  close(master);
+}
+
+static unsigned int ticks_run;
+
+//an update that takes about 2 ms, stopping the loop after ticks_left ticks
+static void slow_update(void* data){
+  (void)data;
+
+  struct timespec ts = { 0, 2000000 };
+  nanosleep(&ts, NULL);
+
+  ticks_run++;
+  count_down(NULL);
+}
+
+void test_loop(){
+  puts("testing the game loop");
+  int null_fd = open("/dev/null", O_WRONLY);
+
+  tge_set_output_fd(null_fd);
+
+  struct tge_loop loop = { .tick_rate = 100, .frame_rate = 25, .update = slow_update };
+
+  //a stop before the loop starts makes it return at once
+  ticks_run = 0;
+  ticks_left = 5;
+  tge_stop();
+  tge_run(&loop);
+
+  expect_uint(ticks_run, 0, "stop before run kept");
+
+  tge_reset_frame_stats();
+  ticks_run = 0;
+  ticks_left = 20;
+  tge_run(&loop);
+
+  struct tge_frame_stats stats = tge_get_frame_stats();
+
+  expect_uint(ticks_run, 20, "stopped by update");
+  expect_uint(stats.ticks, 20, "ticks counted");
+  expect_int(stats.frames >= 4 && stats.frames <= 7, 1, "four ticks a frame");
+  expect_uint(stats.dropped_ticks, 0, "no ticks dropped");
+  //ticks after the last frame are not counted, at most three of them
+  expect_int(stats.total_ns >= 16 * 2000000ULL, 1, "updates between frames counted");
+
+  tge_set_output_fd(STDOUT_FILENO);
+  close(null_fd);
+}
+
+void test_frame_stats(){
+  puts("testing frame statistics");
+  tge_reset_frame_stats();
+
+  for(unsigned long long ms = 100; ms >= 1; ms--){
+    record_frame_time(ms * 1000000);
+  }
+
+  struct tge_frame_stats stats = tge_get_frame_stats();
+
+  expect_uint64_t(stats.frames, 100, "frames");
+  expect_uint64_t(stats.min_ns, 1000000, "min");
+  expect_uint64_t(stats.max_ns, 100000000, "max");
+  expect_uint64_t(stats.avg_ns, 50500000, "average");
+  expect_uint64_t(stats.p99_ns, 99000000, "p99");
+
+  //only the most recent frames are in the percentile
+  for(unsigned int i = 0; i < TGE_FRAME_HISTORY; i++){
+    record_frame_time(1000);
+  }
+
+  stats = tge_get_frame_stats();
+
+  expect_uint64_t(stats.p99_ns, 1000, "p99 of recent frames");
+  expect_uint64_t(stats.max_ns, 100000000, "max of all frames");
+
+  tge_reset_frame_stats();
+  expect_uint64_t(tge_get_frame_stats().frames, 0, "reset");
+}
+
+//keys queued so far, as key codes, in a string
+static void drain_keys(char* keys, size_t size){
+  struct tge_key_event event;
+  size_t length = 0;
+
+  while(dequeue_key(&event) && length + 1 < size){
+    keys[length++] = event.key == TGE_KEY_CHAR ? (char)event.codepoint : 'a' + event.key - TGE_KEY_A;
+  }
+
+  keys[length] = '\0';
+}
+
+void test_input_ring(){
+  puts("testing the input ring");
+  char keys[128];
+
+  //a read that wraps around the end of the ring is split in two
+  input_head = input_tail = TGE_INPUT_BUFFER_SIZE - 6;
+
+  int saved = pipe_stdin("abcdefghij", true);
+
+  expect_int(tge_wait_input(0), 1, "keys read");
+  drain_keys(keys, sizeof(keys));
+  expect_int(strcmp(keys, "abcdefghij"), 0, "keys in order across the wrap");
+
+  dup2(saved, STDIN_FILENO);
+  close(saved);
+
+  //more keys than the queue holds: the oldest are kept, the rest dropped
+  char many[TGE_KEY_QUEUE_SIZE + 37];
+
+  memset(many, 'q', sizeof(many) - 1);
+  many[sizeof(many) - 1] = '\0';
+  input_closed = false;
+  saved = pipe_stdin(many, true);
+
+  tge_wait_input(0);
+  drain_keys(keys, sizeof(keys));
+  expect_uint(strlen(keys), TGE_KEY_QUEUE_SIZE, "queue keeps what fits");
+  expect_uint(input_tail - input_head, 0, "every byte consumed");
+
+  dup2(saved, STDIN_FILENO);
+  close(saved);
+
+  //a full ring reads nothing more until it is parsed
+  input_closed = false;
+  saved = pipe_stdin("z", false);
+  input_tail = input_head + TGE_INPUT_BUFFER_SIZE;
+
+  input_read();
+
+  char byte = 0;
+  expect_uint(input_tail - input_head, TGE_INPUT_BUFFER_SIZE, "full ring not overrun");
+  expect_int(read(STDIN_FILENO, &byte, 1) == 1 && byte == 'z', 1, "input left in place");
+
+  dup2(saved, STDIN_FILENO);
+  close(saved);
+  input_head = input_tail = 0;
+  key_head = key_tail = 0;
+  input_closed = false;
+}
+
+//append bytes to the input ring as if just read, then parse them
+static void feed_input(const char* bytes){
+  for(; *bytes != '\0'; bytes++){
+    input_buffer[input_tail++ & (TGE_INPUT_BUFFER_SIZE - 1)] = *bytes;
+  }
+
+  input_parse(false);
+}
+
+static void expect_key(int key, unsigned int mods, unsigned int codepoint, char* desc){
+  struct tge_key_event event = { .key = TGE_KEY_NONE };
+
+  dequeue_key(&event);
+  expect_int(event.key, key, desc);
+  expect_uint(event.mods, mods, desc);
+  expect_uint(event.codepoint, codepoint, desc);
+}
+
+void test_input_decoding(){
+  puts("testing key decoding");
+
+  feed_input("aA\x01\r\t\x7F\x1B\x1B[B");
+  expect_key(TGE_KEY_A, 0, 'a', "letter");
+  expect_key(TGE_KEY_A, TGE_MOD_SHIFT, 'A', "shifted letter");
+  expect_key(TGE_KEY_A, TGE_MOD_CTRL, 0, "control letter");
+  expect_key(TGE_KEY_ENTER, 0, 0, "enter");
+  expect_key(TGE_KEY_TAB, 0, 0, "tab");
+  expect_key(TGE_KEY_BACKSPACE, 0, 0, "backspace");
+  expect_key(TGE_KEY_ESC, 0, 0, "escape before a sequence");
+  expect_key(TGE_KEY_DOWN, 0, 0, "sequence after an escape");
+
+  feed_input("\x1B[A\x1B[1;5A\x1B[1;2D\x1B[Z\x1B[H");
+  expect_key(TGE_KEY_UP, 0, 0, "csi arrow");
+  expect_key(TGE_KEY_UP, TGE_MOD_CTRL, 0, "csi arrow with ctrl");
+  expect_key(TGE_KEY_LEFT, TGE_MOD_SHIFT, 0, "csi arrow with shift");
+  expect_key(TGE_KEY_TAB, TGE_MOD_SHIFT, 0, "back tab");
+  expect_key(TGE_KEY_HOME, 0, 0, "csi home");
+
+  feed_input("\x1BOP\x1BO5A\x1BOM");
+  expect_key(TGE_KEY_F1, 0, 0, "ss3 function key");
+  expect_key(TGE_KEY_UP, TGE_MOD_CTRL, 0, "ss3 arrow with ctrl");
+  expect_key(TGE_KEY_ENTER, 0, 0, "keypad enter");
+
+  feed_input("\x1B[15~\x1B[24;2~\x1B[3;7~\x1B[5~");
+  expect_key(TGE_KEY_F5, 0, 0, "tilde F5");
+  expect_key(TGE_KEY_F12, TGE_MOD_SHIFT, 0, "tilde F12 with shift");
+  expect_key(TGE_KEY_DELETE, TGE_MOD_ALT | TGE_MOD_CTRL, 0, "tilde delete with alt and ctrl");
+  expect_key(TGE_KEY_PAGE_UP, 0, 0, "tilde page up");
+
+  feed_input("\x1B" "a\x1B" "B");
+  expect_key(TGE_KEY_A, TGE_MOD_ALT, 'a', "alt letter");
+  expect_key(TGE_KEY_B, TGE_MOD_ALT | TGE_MOD_SHIFT, 'B', "alt shifted letter");
+
+  feed_input("\xC3\xA9\xE7\x8C\xAB");
+  expect_key(TGE_KEY_CHAR, 0, 0xE9, "two byte character");
+  expect_key(TGE_KEY_CHAR, 0, 0x732B, "three byte character");
+
+  //sequences cut off by the end of a read wait for the rest
+  feed_input("\xE7\x8C");
+  expect_int(key_head == key_tail, 1, "half a character waits");
+  feed_input("\xAB");
+  expect_key(TGE_KEY_CHAR, 0, 0x732B, "character split across reads");
+
+  feed_input("\x1B[1;");
+  expect_int(key_head == key_tail, 1, "half a sequence waits");
+  feed_input("5C");
+  expect_key(TGE_KEY_RIGHT, TGE_MOD_CTRL, 0, "sequence split across reads");
+
+  feed_input("\x1B" "\xC3");
+  feed_input("\xA9");
+  expect_key(TGE_KEY_CHAR, TGE_MOD_ALT, 0xE9, "alt character split across reads");
+
+  //mouse reports and paste brackets make no keys, pasted text still does
+  feed_input("\x1B[<0;10;5M\x1B[<0;10;5m\x1B[?1;2c\x1B[200~x\x1B[201~");
+  expect_key(TGE_KEY_X, 0, 'x', "only the pasted key");
+  expect_int(key_head == key_tail, 1, "sequences ignored");
+  expect_uint(input_tail - input_head, 0, "sequences consumed");
+
+  //a lone escape is only a key once no more of a sequence arrives
+  bool was_closed = input_closed;
+
+  input_closed = true;
+  feed_input("\x1B");
+  expect_int(key_head == key_tail, 1, "escape waits for more");
+
+  unsigned long long start = monotonic_ns();
+  bool key = tge_wait_input(1000);
+  unsigned long long waited = monotonic_ns() - start;
+
+  expect_int(key, 1, "escape after the timeout");
+  expect_key(TGE_KEY_ESC, 0, 0, "lone escape");
+  expect_int(waited < 500000000ULL, 1, "wait ends at the timeout");
+  expect_uint(input_stalled_since, 0, "stall cleared");
+
+  input_closed = was_closed;
+  input_head = input_tail = 0;
+  key_head = key_tail = 0;
+}
+
+static void expect_sgr(const struct tge_style* from, struct tge_style to, const char* expected, char* desc){
+  char buf[MAX_SGR_LENGTH + 1];
+  size_t length = format_style(buf, from, &to);
+
+  buf[length] = '\0';
+  expect_int(strcmp(buf, expected), 0, desc);
+}
+
+static bool same_style(struct tge_style a, struct tge_style b){
+  return a.fg == b.fg && a.bg == b.bg && a.attrs == b.attrs;
+}
+
+void test_styles(){
+  puts("testing styles");
+  struct tge_style plain = { 0 };
+  struct tge_style bold_red = { .fg = TGE_COLOUR_INDEXED(1), .attrs = TGE_ATTR_BOLD };
+  struct tge_style bold_dim = { .attrs = TGE_ATTR_BOLD | TGE_ATTR_DIM };
+
+  expect_sgr(NULL, plain, "\x1B[0m", "reset");
+  expect_sgr(NULL, bold_red, "\x1B[0;1;31m", "reset to bold red");
+  expect_sgr(&bold_red, (struct tge_style){ .fg = TGE_COLOUR_INDEXED(9) }, "\x1B[22;91m", "bold off, bright red");
+  expect_sgr(&bold_red, plain, "\x1B[22;39m", "back to default");
+  expect_sgr(&plain, (struct tge_style){ .fg = TGE_COLOUR_INDEXED(200), .bg = TGE_COLOUR_RGB(1, 2, 3) },
+    "\x1B[38;5;200;48;2;1;2;3m", "palette and truecolor");
+  //22 turns off bold with dim, so bold is turned on again
+  expect_sgr(&bold_dim, (struct tge_style){ .attrs = TGE_ATTR_BOLD }, "\x1B[22;1m", "dim off keeps bold");
+  //an empty SGR would be a reset
+  expect_sgr(&bold_red, bold_red, "", "no change");
+
+  struct tge_style styles[] = {
+    plain,
+    bold_red,
+    bold_dim,
+    { .fg = TGE_COLOUR_INDEXED(15), .bg = TGE_COLOUR_INDEXED(8), .attrs = TGE_ATTR_ITALIC | TGE_ATTR_STRIKE },
+    { .fg = TGE_COLOUR_INDEXED(16), .bg = TGE_COLOUR_INDEXED(255), .attrs = TGE_ATTR_UNDERLINE | TGE_ATTR_BLINK },
+    { .fg = TGE_COLOUR_RGB(0, 0, 0), .bg = TGE_COLOUR_RGB(255, 255, 255), .attrs = TGE_ATTR_REVERSE | TGE_ATTR_DIM },
+    { .bg = TGE_COLOUR_INDEXED(7), .attrs = 0x7F }
+  };
+  unsigned int count = sizeof(styles) / sizeof(styles[0]);
+  unsigned int round_trips = 0;
+
+  //a reset to one style followed by the change to another parses back to the second
+  for(unsigned int i = 0; i < count; i++){
+    for(unsigned int j = 0; j < count; j++){
+      char buf[2 * MAX_SGR_LENGTH + 1];
+      size_t length = format_style(buf, NULL, &styles[i]);
+
+      length += format_style(&buf[length], &styles[i], &styles[j]);
+      buf[length] = '\0';
+
+      round_trips += same_style(tge_style_from_sgr(buf), styles[j]);
+    }
+  }
+
+  expect_uint(round_trips, count * count, "round trips");
+
+  struct tge_style parsed = tge_style_from_sgr("\x1B[1;2;4;31;42m\x1B[22m");
+  expect_int(same_style(parsed, (struct tge_style){ .fg = TGE_COLOUR_INDEXED(1), .bg = TGE_COLOUR_INDEXED(2), .attrs = TGE_ATTR_UNDERLINE }), 1, "22 clears bold and dim");
+
+  parsed = tge_style_from_sgr("\x1B[1;31;44m\x1B[m");
+  expect_int(same_style(parsed, plain), 1, "empty SGR resets");
+
+  parsed = tge_style_from_sgr("\x1B[3;97;105m\x1B[23;39;49m");
+  expect_int(same_style(parsed, plain), 1, "each part turned off");
+
+  parsed = tge_style_from_sgr("\x1B[38;5;123;48;2;10;20;30;7m");
+  expect_int(same_style(parsed, (struct tge_style){ .fg = TGE_COLOUR_INDEXED(123), .bg = TGE_COLOUR_RGB(10, 20, 30), .attrs = TGE_ATTR_REVERSE }), 1, "extended colours");
+}
+
+void test_colour_reduction(){
+  puts("testing colour reduction");
+  enum tge_colour_mode saved = colour_mode;
+
+  //thresholds sit halfway between xterm's cube levels 0, 95, 135, 175, 215, 255
+  expect_uint(cube_level(0), 0, "level 0");
+  expect_uint(cube_level(47), 0, "below 48");
+  expect_uint(cube_level(48), 1, "48");
+  expect_uint(cube_level(114), 1, "below 115");
+  expect_uint(cube_level(115), 2, "115");
+  expect_uint(cube_level(154), 2, "below 155");
+  expect_uint(cube_level(155), 3, "155");
+  expect_uint(cube_level(194), 3, "below 195");
+  expect_uint(cube_level(195), 4, "195");
+  expect_uint(cube_level(234), 4, "below 235");
+  expect_uint(cube_level(235), 5, "235");
+  expect_uint(cube_level(255), 5, "level 5");
+
+  colour_mode = TGE_COLOUR_MODE_TRUECOLOR;
+  expect_uint(colour_for_mode(TGE_COLOUR_RGB(1, 2, 3)), TGE_COLOUR_RGB(1, 2, 3), "truecolor kept");
+
+  colour_mode = TGE_COLOUR_MODE_256;
+  expect_uint(colour_for_mode(TGE_COLOUR_RGB(0, 0, 0)), TGE_COLOUR_INDEXED(16), "black to cube");
+  expect_uint(colour_for_mode(TGE_COLOUR_RGB(255, 255, 255)), TGE_COLOUR_INDEXED(231), "white to cube");
+  expect_uint(colour_for_mode(TGE_COLOUR_RGB(47, 48, 115)), TGE_COLOUR_INDEXED(16 + 6 + 2), "cube thresholds");
+  expect_uint(colour_for_mode(TGE_COLOUR_INDEXED(200)), TGE_COLOUR_INDEXED(200), "palette kept");
+  expect_uint(colour_for_mode(TGE_COLOUR_DEFAULT), TGE_COLOUR_DEFAULT, "default kept");
+
+  colour_mode = TGE_COLOUR_MODE_16;
+  expect_uint(colour_for_mode(TGE_COLOUR_RGB(205, 0, 0)), TGE_COLOUR_INDEXED(1), "red");
+  expect_uint(colour_for_mode(TGE_COLOUR_RGB(255, 0, 0)), TGE_COLOUR_INDEXED(9), "bright red");
+  expect_uint(colour_for_mode(TGE_COLOUR_RGB(0, 0, 0)), TGE_COLOUR_INDEXED(0), "black");
+  expect_uint(colour_for_mode(TGE_COLOUR_RGB(255, 255, 255)), TGE_COLOUR_INDEXED(15), "white");
+  expect_uint(colour_for_mode(TGE_COLOUR_INDEXED(15)), TGE_COLOUR_INDEXED(15), "basic colour kept");
+  expect_uint(colour_for_mode(TGE_COLOUR_INDEXED(16)), TGE_COLOUR_INDEXED(0), "first cube colour");
+  expect_uint(colour_for_mode(TGE_COLOUR_INDEXED(196)), TGE_COLOUR_INDEXED(9), "cube red");
+  expect_uint(colour_for_mode(TGE_COLOUR_INDEXED(231)), TGE_COLOUR_INDEXED(15), "last cube colour");
+  expect_uint(colour_for_mode(TGE_COLOUR_INDEXED(232)), TGE_COLOUR_INDEXED(0), "darkest grey");
+  expect_uint(colour_for_mode(TGE_COLOUR_INDEXED(244)), TGE_COLOUR_INDEXED(8), "middle grey");
+  expect_uint(colour_for_mode(TGE_COLOUR_INDEXED(255)), TGE_COLOUR_INDEXED(7), "lightest grey");
+  expect_uint(colour_for_mode(TGE_COLOUR_DEFAULT), TGE_COLOUR_DEFAULT, "default kept in 16 colours");
+
+  colour_mode = saved;
+}
+
+//the terminal stdout refers to, whose size a test sets to signal a resize
+static int resize_terminal;
+
+static void resize_to(unsigned short rows, unsigned short cols){
+  struct winsize size = { .ws_row = rows, .ws_col = cols };
+
+  ioctl(resize_terminal, TIOCSWINSZ, &size);
+  handle_terminal_resize(SIGWINCH);
+}
+
+static bool row_text_is(unsigned short y, unsigned short x, const char* text){
+  for(size_t i = 0; text[i] != '\0'; i++){
+    if(back_buffer_cell(x + i, y)->ch != (uint32_t)text[i]){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void test_resize_damage(){
+  puts("testing resizes with damage pending");
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+  grantpt(master);
+  unlockpt(master);
+  resize_terminal = open(ptsname(master), O_RDWR | O_NOCTTY);
+
+  int null_fd = open("/dev/null", O_WRONLY);
+  int saved = dup(STDOUT_FILENO);
+
+  fflush(stdout);
+  dup2(resize_terminal, STDOUT_FILENO);
+  tge_set_output_fd(null_fd);
+
+  struct tge_sprite sprite = tge_sprite_create("ABCDEF");
+
+  //damage recorded for a bigger screen must not be repainted into a smaller one
+  tge_init_headless(40, 100);
+
+  tge_handle handle = tge_object_create((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &sprite });
+
+  tge_present();
+  tge_object_move(handle, (struct tge_vec3){ 90, 35, 0 });
+  resize_to(10, 20);
+  tge_present();
+
+  expect_uint(buffer_rows * 1000 + buffer_cols, 10020, "buffers shrunk");
+  expect_uint(damage_count, 0, "damage repainted");
+  tge_clean();
+
+  //likewise damage from a sideways camera move with no objects
+  tge_init_headless(40, 100);
+  tge_present();
+  tge_set_camera(5, 3);
+  resize_to(10, 20);
+  tge_present();
+
+  expect_uint(damage_count, 0, "camera damage dropped");
+  tge_clean();
+
+  //growing shows the parts of objects that were off screen
+  tge_init_headless(5, 10);
+  tge_object_create((struct tge_game_object){ .pos = { 8, 2, 0 }, .sprite = &sprite });
+  tge_present();
+
+  expect_int(row_text_is(2, 8, "ABC"), 1, "object cut by the edge");
+
+  resize_to(5, 20);
+  tge_present();
+
+  expect_int(row_text_is(2, 8, "ABCDEF"), 1, "object repainted into new columns");
+
+  tge_clean();
+  dup2(saved, STDOUT_FILENO);
+  close(saved);
+  tge_set_output_fd(STDOUT_FILENO);
+  tge_sprite_destroy(&sprite);
+  close(null_fd);
+  close(resize_terminal);
+  close(master);
+}
+
+void test_registry_growth_failure(){
+  puts("testing a failed registry growth");
+  int null_fd = open("/dev/null", O_WRONLY);
+
+  tge_set_output_fd(null_fd);
+  tge_init_headless(5, 10);
+
+  struct tge_sprite sprite = tge_sprite_create("x");
+  tge_handle first = 0;
+
+  while(registry_free != REGISTRY_NIL || registry_capacity == 0){
+    tge_handle handle = tge_object_create((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &sprite });
+
+    if(first == 0){
+      first = handle;
+    }
+  }
+
+  tge_present();
+
+  //the slots move but the order array cannot grow
+  reallocations_move = true;
+  allocations_until_failure = 1;
+
+  tge_handle handle = tge_object_create((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &sprite });
+
+  allocations_until_failure = -1;
+  reallocations_move = false;
+
+  expect_int(handle, 0, "object not created");
+
+  tge_object_move(first, (struct tge_vec3){ 3, 2, 0 });
+  tge_present();
+
+  expect_int(back_buffer_cell(3, 2)->ch, 'x', "moved object repainted");
+
+  tge_clean();
+  tge_set_output_fd(STDOUT_FILENO);
+  tge_sprite_destroy(&sprite);
+  close(null_fd);
+}
+
+int main(){
+  test_sprite_limits();
+  test_closed_input();
+  test_input_ring();
+  test_input_decoding();
+  test_resize();
+  test_resize_damage();
+  test_registry_growth_failure();
+  test_loop();
+  test_frame_stats();
+  test_styles();
+  test_colour_reduction();
+
+  return 0;
+}
@@ -0,0 +1,620 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tge.h"
+#include "tge_vt.h"
+
+enum parser_state {
+  STATE_GROUND,
+  STATE_ESCAPE,
+  STATE_CSI,
+  //OSC and DCS strings are skipped up to their terminator
+  STATE_STRING,
+  STATE_STRING_ESCAPE
+};
+
+static inline struct tge_vt_cell* cell_at(const struct tge_vt* vt, unsigned short x, unsigned short y){
+  return &vt->cells[(size_t)(y - 1) * vt->cols + (x - 1)];
+}
+
+//erased cells take the current background only on terminals with back
+//colour erase
+static inline struct tge_vt_cell blank(const struct tge_vt* vt){
+  return (struct tge_vt_cell){ .ch = ' ', .bg = vt->back_colour_erase ? vt->style.bg : TGE_COLOUR_DEFAULT, .width = 1 };
+}
+
+bool tge_vt_init(struct tge_vt* vt, unsigned short rows, unsigned short cols){
+  *vt = (struct tge_vt){ 0 };
+
+  size_t size = (size_t)rows * cols;
+
+  vt->cells = malloc(size * sizeof(struct tge_vt_cell) + 1);
+
+  if(vt->cells == NULL){
+    return false;
+  }
+
+  vt->rows = rows;
+  vt->cols = cols;
+  vt->cursor_x = 1;
+  vt->cursor_y = 1;
+  vt->cursor_visible = true;
+  vt->scroll_top = 1;
+  vt->scroll_bottom = rows;
+
+  for(size_t i = 0; i < size; i++){
+    vt->cells[i] = blank(vt);
+  }
+
+  return true;
+}
+
+void tge_vt_destroy(struct tge_vt* vt){
+  free(vt->cells);
+
+  *vt = (struct tge_vt){ 0 };
+}
+
+//overwriting either half of a wide glyph leaves the other half blank
+static void break_wide(struct tge_vt* vt, unsigned short from_x, unsigned short to_x, unsigned short y){
+  struct tge_vt_cell* first = cell_at(vt, from_x, y);
+  struct tge_vt_cell* last = cell_at(vt, to_x, y);
+
+  if(first->width == 0 && from_x > 1){
+    first[-1].ch = ' ';
+    first[-1].width = 1;
+  }
+  if(last->width == 2 && to_x < vt->cols){
+    last[1].ch = ' ';
+    last[1].width = 1;
+  }
+}
+
+static void erase(struct tge_vt* vt, unsigned short from_x, unsigned short to_x, unsigned short y){
+  if(from_x > to_x){
+    return;
+  }
+
+  break_wide(vt, from_x, to_x, y);
+
+  struct tge_vt_cell* row = cell_at(vt, 1, y);
+
+  for(unsigned short x = from_x; x <= to_x; x++){
+    row[x - 1] = blank(vt);
+  }
+}
+
+static void erase_rows(struct tge_vt* vt, unsigned short from_y, unsigned short to_y){
+  for(unsigned short y = from_y; y <= to_y; y++){
+    erase(vt, 1, vt->cols, y);
+  }
+}
+
+//move the rows of the scroll region up by n, or down for negative n
+static void scroll(struct tge_vt* vt, int n){
+  int height = vt->scroll_bottom - vt->scroll_top + 1;
+
+  if(n > height){
+    n = height;
+  }
+  if(n < -height){
+    n = -height;
+  }
+
+  size_t row_size = (size_t)vt->cols * sizeof(struct tge_vt_cell);
+  size_t moved = (size_t)(height - abs(n)) * row_size;
+
+  if(n > 0){
+    memmove(cell_at(vt, 1, vt->scroll_top), cell_at(vt, 1, vt->scroll_top + n), moved);
+    erase_rows(vt, vt->scroll_bottom - n + 1, vt->scroll_bottom);
+  } else if(n < 0){
+    memmove(cell_at(vt, 1, vt->scroll_top - n), cell_at(vt, 1, vt->scroll_top), moved);
+    erase_rows(vt, vt->scroll_top, vt->scroll_top - n - 1);
+  }
+}
+
+static void line_feed(struct tge_vt* vt){
+  if(vt->cursor_y == vt->scroll_bottom){
+    scroll(vt, 1);
+  } else if(vt->cursor_y < vt->rows){
+    vt->cursor_y++;
+  }
+}
+
+static void reverse_line_feed(struct tge_vt* vt){
+  if(vt->cursor_y == vt->scroll_top){
+    scroll(vt, -1);
+  } else if(vt->cursor_y > 1){
+    vt->cursor_y--;
+  }
+}
+
+static void print(struct tge_vt* vt, uint32_t codepoint){
+  unsigned int width = tge_glyph_width(codepoint);
+
+  //cells hold one codepoint, so combining characters are dropped
+  if(width == 0 || width > vt->cols){
+    return;
+  }
+
+  if(vt->wrap_pending || vt->cursor_x + width - 1 > vt->cols){
+    vt->cursor_x = 1;
+    vt->wrap_pending = false;
+    line_feed(vt);
+  }
+
+  unsigned short x = vt->cursor_x;
+  unsigned short y = vt->cursor_y;
+  struct tge_vt_cell* cell = cell_at(vt, x, y);
+
+  break_wide(vt, x, x + width - 1, y);
+
+  cell[0] = (struct tge_vt_cell){
+    .ch = codepoint,
+    .fg = vt->style.fg,
+    .bg = vt->style.bg,
+    .attrs = vt->style.attrs,
+    .width = width
+  };
+
+  if(width == 2){
+    cell[1] = (struct tge_vt_cell){ .fg = vt->style.fg, .bg = vt->style.bg, .attrs = vt->style.attrs };
+  }
+
+  vt->last_char = codepoint;
+
+  if(x + width > vt->cols){
+    vt->cursor_x = vt->cols;
+    vt->wrap_pending = true;
+  } else {
+    vt->cursor_x = x + width;
+  }
+}
+
+//parameter i, or fallback when it is missing or 0
+static inline unsigned int param(const struct tge_vt* vt, unsigned int i, unsigned int fallback){
+  return i < vt->param_count && vt->params[i] != 0 ? vt->params[i] : fallback;
+}
+
+static inline unsigned short clamp(unsigned int value, unsigned short low, unsigned short high){
+  return value < low ? low : value > high ? high : value;
+}
+
+static void select_graphic_rendition(struct tge_vt* vt){
+  struct tge_style* style = &vt->style;
+  unsigned int count = vt->param_count == 0 ? 1 : vt->param_count;
+
+  for(unsigned int i = 0; i < count; i++){
+    unsigned int p = i < vt->param_count ? vt->params[i] : 0;
+
+    if(p == 0){
+      *style = (struct tge_style){ 0 };
+    } else if(p == 38 || p == 48){
+      uint32_t* colour = p == 38 ? &style->fg : &style->bg;
+
+      if(i + 2 < count && vt->params[i + 1] == 5){
+        *colour = TGE_COLOUR_INDEXED(vt->params[i + 2]);
+        i += 2;
+      } else if(i + 4 < count && vt->params[i + 1] == 2){
+        *colour = TGE_COLOUR_RGB(vt->params[i + 2], vt->params[i + 3], vt->params[i + 4]);
+        i += 4;
+      } else {
+        vt->unknown++;
+        return;
+      }
+    } else if(p >= 30 && p <= 37){
+      style->fg = TGE_COLOUR_INDEXED(p - 30);
+    } else if(p >= 90 && p <= 97){
+      style->fg = TGE_COLOUR_INDEXED(p - 90 + 8);
+    } else if(p == 39){
+      style->fg = TGE_COLOUR_DEFAULT;
+    } else if(p >= 40 && p <= 47){
+      style->bg = TGE_COLOUR_INDEXED(p - 40);
+    } else if(p >= 100 && p <= 107){
+      style->bg = TGE_COLOUR_INDEXED(p - 100 + 8);
+    } else if(p == 49){
+      style->bg = TGE_COLOUR_DEFAULT;
+    } else if(p == 1){
+      style->attrs |= TGE_ATTR_BOLD;
+    } else if(p == 2){
+      style->attrs |= TGE_ATTR_DIM;
+    } else if(p == 3){
+      style->attrs |= TGE_ATTR_ITALIC;
+    } else if(p == 4){
+      style->attrs |= TGE_ATTR_UNDERLINE;
+    } else if(p == 5){
+      style->attrs |= TGE_ATTR_BLINK;
+    } else if(p == 7){
+      style->attrs |= TGE_ATTR_REVERSE;
+    } else if(p == 9){
+      style->attrs |= TGE_ATTR_STRIKE;
+    } else if(p == 22){
+      style->attrs &= ~(TGE_ATTR_BOLD | TGE_ATTR_DIM);
+    } else if(p == 23){
+      style->attrs &= ~TGE_ATTR_ITALIC;
+    } else if(p == 24){
+      style->attrs &= ~TGE_ATTR_UNDERLINE;
+    } else if(p == 25){
+      style->attrs &= ~TGE_ATTR_BLINK;
+    } else if(p == 27){
+      style->attrs &= ~TGE_ATTR_REVERSE;
+    } else if(p == 29){
+      style->attrs &= ~TGE_ATTR_STRIKE;
+    } else {
+      vt->unknown++;
+    }
+  }
+}
+
+static void set_private_mode(struct tge_vt* vt, bool enable){
+  for(unsigned int i = 0; i < vt->param_count; i++){
+    if(vt->params[i] == 25){
+      vt->cursor_visible = enable;
+    } else if(vt->params[i] != 2026){
+      //synchronized output changes nothing for an in memory screen
+      vt->unknown++;
+    }
+  }
+}
+
+static void csi_dispatch(struct tge_vt* vt, char final){
+  unsigned short x = vt->cursor_x;
+  unsigned short y = vt->cursor_y;
+  unsigned int n = param(vt, 0, 1);
+
+  if(vt->prefix == '?'){
+    if(final == 'h' || final == 'l'){
+      set_private_mode(vt, final == 'h');
+    } else {
+      vt->unknown++;
+    }
+    return;
+  }
+  if(vt->prefix != 0){
+    vt->unknown++;
+    return;
+  }
+
+  switch(final){
+    case 'H':
+    case 'f':
+      vt->cursor_y = clamp(param(vt, 0, 1), 1, vt->rows);
+      vt->cursor_x = clamp(param(vt, 1, 1), 1, vt->cols);
+      break;
+    case 'A':
+      vt->cursor_y = clamp(y > n ? y - n : 1, y >= vt->scroll_top ? vt->scroll_top : 1, vt->rows);
+      break;
+    case 'B':
+      vt->cursor_y = clamp(y + n, 1, y <= vt->scroll_bottom ? vt->scroll_bottom : vt->rows);
+      break;
+    case 'C':
+      vt->cursor_x = clamp(x + n, 1, vt->cols);
+      break;
+    case 'D':
+      vt->cursor_x = clamp(x > n ? x - n : 1, 1, vt->cols);
+      break;
+    case 'G':
+      vt->cursor_x = clamp(n, 1, vt->cols);
+      break;
+    case 'd':
+      vt->cursor_y = clamp(n, 1, vt->rows);
+      break;
+    case 'J':
+      if(param(vt, 0, 0) == 0){
+        erase(vt, x, vt->cols, y);
+        erase_rows(vt, y + 1, vt->rows);
+      } else if(param(vt, 0, 0) == 1){
+        erase_rows(vt, 1, y - 1);
+        erase(vt, 1, x, y);
+      } else {
+        erase_rows(vt, 1, vt->rows);
+      }
+      break;
+    case 'K':
+      if(param(vt, 0, 0) == 0){
+        erase(vt, x, vt->cols, y);
+      } else if(param(vt, 0, 0) == 1){
+        erase(vt, 1, x, y);
+      } else {
+        erase(vt, 1, vt->cols, y);
+      }
+      break;
+    case 'X':
+      erase(vt, x, clamp(x + n - 1, 1, vt->cols), y);
+      break;
+    case 'b':
+      for(unsigned int i = 0; i < n && vt->last_char != 0; i++){
+        print(vt, vt->last_char);
+      }
+      return;
+    case 'S':
+      scroll(vt, n);
+      break;
+    case 'T':
+      scroll(vt, -(int)n);
+      break;
+    case 'r': {
+      unsigned int top = param(vt, 0, 1);
+      unsigned int bottom = param(vt, 1, vt->rows);
+
+      if(top < bottom && bottom <= vt->rows){
+        vt->scroll_top = top;
+        vt->scroll_bottom = bottom;
+        vt->cursor_x = 1;
+        vt->cursor_y = 1;
+      }
+      break;
+    }
+    case 'm':
+      select_graphic_rendition(vt);
+      return;
+    default:
+      vt->unknown++;
+      return;
+  }
+
+  vt->wrap_pending = false;
+}
+
+static void escape_dispatch(struct tge_vt* vt, char c){
+  vt->state = STATE_GROUND;
+
+  switch(c){
+    case '[':
+      vt->state = STATE_CSI;
+      vt->param_count = 0;
+      vt->prefix = 0;
+      break;
+    case ']':
+    case 'P':
+    case '_':
+    case '^':
+      vt->state = STATE_STRING;
+      break;
+    case 'D':
+      line_feed(vt);
+      break;
+    case 'E':
+      vt->cursor_x = 1;
+      vt->wrap_pending = false;
+      line_feed(vt);
+      break;
+    case 'M':
+      reverse_line_feed(vt);
+      break;
+    default:
+      vt->unknown++;
+      break;
+  }
+}
+
+static void control(struct tge_vt* vt, unsigned char c){
+  switch(c){
+    case '\r':
+      vt->cursor_x = 1;
+      vt->wrap_pending = false;
+      break;
+    case '\n':
+    case '\v':
+    case '\f':
+      line_feed(vt);
+      break;
+    case '\b':
+      if(vt->cursor_x > 1){
+        vt->cursor_x--;
+      }
+      vt->wrap_pending = false;
+      break;
+    case '\t':
+      vt->cursor_x = clamp((vt->cursor_x - 1) / 8 * 8 + 9, 1, vt->cols);
+      break;
+    case '\a':
+      break;
+    default:
+      vt->unknown++;
+      break;
+  }
+}
+
+static void ground(struct tge_vt* vt, unsigned char c){
+  if(vt->utf8_remaining > 0){
+    if((c & 0xC0) == 0x80){
+      vt->codepoint = (vt->codepoint << 6) | (c & 0x3F);
+
+      if(--vt->utf8_remaining == 0){
+        print(vt, vt->codepoint);
+      }
+      return;
+    }
+
+    //cut short by something other than a continuation byte
+    vt->utf8_remaining = 0;
+    print(vt, 0xFFFD);
+  }
+
+  if(c == 0x1B){
+    vt->state = STATE_ESCAPE;
+  } else if(c < 0x20 || c == 0x7F){
+    control(vt, c);
+  } else if(c < 0x80){
+    print(vt, c);
+  } else if(c >= 0xC0 && c < 0xF8){
+    vt->utf8_remaining = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : 1;
+    vt->codepoint = c & (0x3F >> vt->utf8_remaining);
+  } else {
+    print(vt, 0xFFFD);
+  }
+}
+
+void tge_vt_feed(struct tge_vt* vt, const char* bytes, size_t length){
+  vt->bytes += length;
+
+  for(size_t i = 0; i < length; i++){
+    unsigned char c = bytes[i];
+
+    switch(vt->state){
+      case STATE_GROUND:
+        ground(vt, c);
+        break;
+      case STATE_ESCAPE:
+        escape_dispatch(vt, c);
+        break;
+      case STATE_CSI:
+        if(c >= '0' && c <= '9'){
+          if(vt->param_count == 0){
+            vt->params[vt->param_count++] = 0;
+          }
+          if(vt->param_count <= TGE_VT_MAX_PARAMS){
+            unsigned int* p = &vt->params[vt->param_count - 1];
+            *p = *p > 100000 ? *p : *p * 10 + (c - '0');
+          }
+        } else if(c == ';'){
+          if(vt->param_count == 0){
+            vt->params[vt->param_count++] = 0;
+          }
+          if(vt->param_count < TGE_VT_MAX_PARAMS){
+            vt->params[vt->param_count++] = 0;
+          }
+        } else if(c >= '<' && c <= '?'){
+          vt->prefix = c;
+        } else if(c >= 0x40 && c <= 0x7E){
+          vt->state = STATE_GROUND;
+          csi_dispatch(vt, c);
+        } else if(c < 0x20 || c > 0x7E){
+          //malformed, drop the sequence
+          vt->state = STATE_GROUND;
+          vt->unknown++;
+        }
+        break;
+      case STATE_STRING:
+        if(c == '\a'){
+          vt->state = STATE_GROUND;
+        } else if(c == 0x1B){
+          vt->state = STATE_STRING_ESCAPE;
+        }
+        break;
+      case STATE_STRING_ESCAPE:
+        vt->state = c == '\\' ? STATE_GROUND : STATE_STRING;
+        break;
+    }
+  }
+}
+
+static size_t backend_write(void* data, const char* bytes, size_t length){
+  tge_vt_feed(data, bytes, length);
+  return length;
+}
+
+struct tge_output_backend tge_vt_backend(struct tge_vt* vt){
+  return (struct tge_output_backend){ .write = backend_write, .data = vt };
+}
+
+const struct tge_vt_cell* tge_vt_cell_at(const struct tge_vt* vt, unsigned short x, unsigned short y){
+  return cell_at(vt, x, y);
+}
+
+bool tge_vt_snapshot(const struct tge_vt* vt, struct tge_vt* snapshot){
+  size_t size = (size_t)vt->rows * vt->cols * sizeof(struct tge_vt_cell);
+
+  *snapshot = *vt;
+  snapshot->cells = malloc(size + 1);
+
+  if(snapshot->cells == NULL){
+    *snapshot = (struct tge_vt){ 0 };
+    return false;
+  }
+
+  memcpy(snapshot->cells, vt->cells, size);
+
+  return true;
+}
+
+bool tge_vt_compare(const struct tge_vt* a, const struct tge_vt* b, unsigned short* x, unsigned short* y){
+  unsigned short diff_x = 0;
+  unsigned short diff_y = 0;
+  bool equal = a->rows == b->rows && a->cols == b->cols;
+
+  for(unsigned short row = 1; row <= a->rows && equal; row++){
+    const struct tge_vt_cell* cells_a = cell_at(a, 1, row);
+    const struct tge_vt_cell* cells_b = cell_at(b, 1, row);
+
+    if(memcmp(cells_a, cells_b, a->cols * sizeof(struct tge_vt_cell)) == 0){
+      continue;
+    }
+
+    for(unsigned short col = 1; col <= a->cols && equal; col++){
+      if(memcmp(&cells_a[col - 1], &cells_b[col - 1], sizeof(struct tge_vt_cell)) != 0){
+        equal = false;
+        diff_x = col;
+        diff_y = row;
+      }
+    }
+  }
+
+  if(x != NULL){
+    *x = diff_x;
+  }
+  if(y != NULL){
+    *y = diff_y;
+  }
+
+  return equal;
+}
+
+static size_t encode_utf8(uint32_t codepoint, char* bytes){
+  if(codepoint < 0x80){
+    bytes[0] = codepoint;
+    return 1;
+  }
+  if(codepoint < 0x800){
+    bytes[0] = 0xC0 | codepoint >> 6;
+    bytes[1] = 0x80 | (codepoint & 0x3F);
+    return 2;
+  }
+  if(codepoint < 0x10000){
+    bytes[0] = 0xE0 | codepoint >> 12;
+    bytes[1] = 0x80 | (codepoint >> 6 & 0x3F);
+    bytes[2] = 0x80 | (codepoint & 0x3F);
+    return 3;
+  }
+
+  bytes[0] = 0xF0 | codepoint >> 18;
+  bytes[1] = 0x80 | (codepoint >> 12 & 0x3F);
+  bytes[2] = 0x80 | (codepoint >> 6 & 0x3F);
+  bytes[3] = 0x80 | (codepoint & 0x3F);
+  return 4;
+}
+
+size_t tge_vt_text(const struct tge_vt* vt, char* buf, size_t size){
+  size_t length = 0;
+
+  for(unsigned short y = 1; y <= vt->rows; y++){
+    for(unsigned short x = 1; x <= vt->cols + 1; x++){
+      char bytes[4];
+      size_t count;
+
+      if(x > vt->cols){
+        bytes[0] = '\n';
+        count = 1;
+      } else if(cell_at(vt, x, y)->width == 0){
+        continue;
+      } else {
+        count = encode_utf8(cell_at(vt, x, y)->ch, bytes);
+      }
+
+      for(size_t i = 0; i < count; i++, length++){
+        if(length + 1 < size){
+          buf[length] = bytes[i];
+        }
+      }
+    }
+  }
+
+  if(size > 0){
+    buf[length < size ? length : size - 1] = '\0';
+  }
+
+  return length;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tge.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TGE_VT_MAX_PARAMS 16
+
+/*A character cell. A wide glyph has width 2 and is followed by a cell of
+  width 0 with no codepoint*/
+struct tge_vt_cell {
+  uint32_t ch;
+  uint32_t fg;
+  uint32_t bg;
+  uint8_t attrs;
+  uint8_t width;
+  uint16_t padding;
+};
+
+/*An in memory terminal. It understands the output tge produces: cursor
+  motion, erasing, scrolling and scroll regions, SGR styles, REP and UTF-8.
+  Anything else is counted in unknown and otherwise ignored*/
+struct tge_vt {
+  unsigned short rows;
+  unsigned short cols;
+  struct tge_vt_cell* cells;
+  /*1 based. After printing in the last column the cursor stays there with
+    a wrap pending, like a real terminal*/
+  unsigned short cursor_x;
+  unsigned short cursor_y;
+  bool wrap_pending;
+  bool cursor_visible;
+  struct tge_style style;
+  /*Erasing fills cells with the current background colour instead of the
+    default one. Off after tge_vt_init*/
+  bool back_colour_erase;
+  /*The scroll region set by DECSTBM, inclusive*/
+  unsigned short scroll_top;
+  unsigned short scroll_bottom;
+  /*Last character printed, repeated by REP*/
+  uint32_t last_char;
+  unsigned long long bytes;
+  unsigned long long unknown;
+  /*Parser state, kept between calls so sequences may be split anywhere*/
+  int state;
+  unsigned int params[TGE_VT_MAX_PARAMS];
+  unsigned int param_count;
+  char prefix;
+  uint32_t codepoint;
+  unsigned int utf8_remaining;
+};
+
+/*Create a blank rows by cols terminal. Return false if allocation fails*/
+bool tge_vt_init(struct tge_vt* vt, unsigned short rows, unsigned short cols);
+void tge_vt_destroy(struct tge_vt* vt);
+/*Interpret length bytes of terminal output*/
+void tge_vt_feed(struct tge_vt* vt, const char* bytes, size_t length);
+/*An output backend that feeds everything the engine outputs into vt*/
+struct tge_output_backend tge_vt_backend(struct tge_vt* vt);
+/*The cell at 1 based x, y*/
+const struct tge_vt_cell* tge_vt_cell_at(const struct tge_vt* vt, unsigned short x, unsigned short y);
+/*Copy the screen and cursor of vt into snapshot, which must be destroyed
+  afterwards. Return false if allocation fails*/
+bool tge_vt_snapshot(const struct tge_vt* vt, struct tge_vt* snapshot);
+/*Return true if both screens hold the same cells. Otherwise x and y, if
+  not NULL, are set to the first cell that differs, or 0 if sizes differ*/
+bool tge_vt_compare(const struct tge_vt* a, const struct tge_vt* b, unsigned short* x, unsigned short* y);
+/*Write the screen as UTF-8 text, one line per row, without styles. At most
+  size bytes are written including a NUL. Return the length of the full text*/
+size_t tge_vt_text(const struct tge_vt* vt, char* buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
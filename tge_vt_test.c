@@ -0,0 +1,914 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "tge.c"
+#include "tge_vt.c"
+#include "tge_vt.h"
+#include "test.h"
+
+static void feed(struct tge_vt* vt, const char* text){
+  tge_vt_feed(vt, text, strlen(text));
+}
+
+static bool text_is(struct tge_vt* vt, const char* expected){
+  char text[256];
+  tge_vt_text(vt, text, sizeof(text));
+  return strcmp(text, expected) == 0;
+}
+
+void test_sequences(){
+  puts("testing escape sequences");
+  struct tge_vt vt;
+
+  expect_int(tge_vt_init(&vt, 3, 6), 1, "created");
+
+  feed(&vt, "ab\x1B[2;3Hcd\x1B[3;5Hef");
+  expect_int(text_is(&vt, "ab    \n  cd  \n    ef\n"), 1, "cursor positioning");
+  expect_int(vt.wrap_pending, 1, "wrap pending after last column");
+
+  feed(&vt, "g");
+  expect_int(text_is(&vt, "  cd  \n    ef\ng     \n"), 1, "wrap at bottom scrolls");
+
+  feed(&vt, "\x1B[H\x1B[2J\x1B[1;31mx\x1B[m\x1B[4b");
+  expect_uint(tge_vt_cell_at(&vt, 1, 1)->fg, TGE_COLOUR_INDEXED(1), "sgr colour");
+  expect_uint(tge_vt_cell_at(&vt, 1, 1)->attrs, TGE_ATTR_BOLD, "sgr attribute");
+  expect_int(text_is(&vt, "xxxxx \n      \n      \n"), 1, "repeat");
+  expect_uint(tge_vt_cell_at(&vt, 2, 1)->fg, TGE_COLOUR_DEFAULT, "repeat uses the current style");
+
+  feed(&vt, "\x1B[1;2H\x1B[2X\x1B[C\x1B[Dq");
+  expect_int(text_is(&vt, "xq xx \n      \n      \n"), 1, "erase characters without moving");
+
+  feed(&vt, "\x1B[H\x1B[2J1\r\n2\r\n3\x1B[2;3r\x1B[S");
+  expect_int(text_is(&vt, "1     \n3     \n      \n"), 1, "scroll up within region");
+  feed(&vt, "\x1B[T");
+  expect_int(text_is(&vt, "1     \n      \n3     \n"), 1, "scroll down within region");
+  feed(&vt, "\x1B[r");
+
+  //a wide glyph split across two feeds, then half of it overwritten
+  feed(&vt, "\x1B[H\x1B[2J\xE7\x8C");
+  feed(&vt, "\xAB!");
+  expect_uint(tge_vt_cell_at(&vt, 1, 1)->width, 2, "wide glyph");
+  expect_uint(tge_vt_cell_at(&vt, 2, 1)->width, 0, "continuation cell");
+  expect_int(text_is(&vt, "\xE7\x8C\xAB!   \n      \n      \n"), 1, "utf-8 text");
+  feed(&vt, "\x1B[1;2H-");
+  expect_int(text_is(&vt, " -!   \n      \n      \n"), 1, "overwritten half clears the other");
+
+  struct tge_vt snapshot;
+
+  expect_int(tge_vt_snapshot(&vt, &snapshot), 1, "snapshot taken");
+  expect_int(tge_vt_compare(&vt, &snapshot, NULL, NULL), 1, "snapshot equal");
+
+  unsigned short x;
+  unsigned short y;
+
+  feed(&vt, "\x1B[3;4H#");
+  expect_int(tge_vt_compare(&vt, &snapshot, &x, &y), 0, "change detected");
+  expect_uint(x * 10 + y, 43, "first difference");
+  expect_uint(vt.unknown, 0, "every sequence understood");
+
+  tge_vt_destroy(&snapshot);
+  tge_vt_destroy(&vt);
+}
+
+//the screen the renderer produced must hold exactly what it meant to draw
+static unsigned int mismatched_cells(struct tge_vt* vt){
+  unsigned int mismatched = 0;
+
+  for(unsigned short y = 1; y <= buffer_rows; y++){
+    for(unsigned short x = 1; x <= buffer_cols; x++){
+      const struct tge_vt_cell* shown = tge_vt_cell_at(vt, x, y);
+      const struct cell* drawn = back_buffer_cell(x, y);
+
+      mismatched += shown->ch != drawn->ch || shown->width != drawn->width || shown->fg != drawn->fg ||
+                    shown->bg != drawn->bg || shown->attrs != drawn->attrs;
+    }
+  }
+
+  return mismatched;
+}
+
+#define OBJECT_COUNT 40
+#define FRAMES 300
+
+void test_renderer_matches(){
+  puts("testing rendered output matches the frame");
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 24, 80);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(24, 80);
+
+  struct tge_sprite sprites[4] = {
+    tge_sprite_create("<o>\n/ \\"),
+    tge_sprite_create("┌─┐\n│猫│\n└─┘"),
+    tge_sprite_create("猫猫猫"),
+    tge_sprite_create("#####\n#   #\n#####")
+  };
+  struct tge_game_object objects[OBJECT_COUNT];
+  unsigned int seed = 7;
+
+  for(int i = 0; i < OBJECT_COUNT; i++){
+    objects[i] = (struct tge_game_object){
+      .pos = { i * 2 % 80, i % 24, i % 3 },
+      .sprite = &sprites[i % 4],
+      .style = {
+        .fg = i % 5 == 0 ? TGE_COLOUR_RGB(i * 6, 255 - i * 6, 128) : TGE_COLOUR_INDEXED(i % 16),
+        .bg = i % 3 == 0 ? TGE_COLOUR_INDEXED(232 + i % 24) : TGE_COLOUR_DEFAULT,
+        .attrs = i % 128
+      }
+    };
+  }
+
+  unsigned int mismatched = 0;
+
+  for(int frame = 0; frame < FRAMES; frame++){
+    for(int i = 0; i < OBJECT_COUNT; i++){
+      tge_clear_game_object(objects[i]);
+    }
+
+    for(int i = 0; i < OBJECT_COUNT; i++){
+      seed = seed * 1103515245 + 12345;
+      objects[i].pos.x += (int)(seed >> 16) % 5 - 2;
+      objects[i].pos.y += (int)(seed >> 20) % 3 - 1;
+    }
+
+    if(frame == FRAMES / 3){
+      tge_set_capabilities(TGE_CAP_REP | TGE_CAP_ECH);
+    }
+    if(frame == FRAMES / 2){
+      tge_set_colour_mode(TGE_COLOUR_MODE_16);
+    }
+
+    tge_draw_scene(objects, OBJECT_COUNT);
+    tge_present();
+
+    mismatched += mismatched_cells(&vt);
+  }
+
+  expect_uint(mismatched, 0, "every cell matches after every frame");
+  expect_uint(vt.unknown, 0, "every sequence understood");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+
+  for(int i = 0; i < 4; i++){
+    tge_sprite_destroy(&sprites[i]);
+  }
+
+  tge_vt_destroy(&vt);
+}
+
+void test_registry(){
+  puts("testing the object registry");
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 5, 10);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(5, 10);
+
+  struct tge_sprite wall = tge_sprite_create("####\n####");
+  struct tge_sprite ship = tge_sprite_create("猫>");
+  tge_handle below = tge_object_create((struct tge_game_object){ .pos = { 2, 2, 0 }, .sprite = &wall });
+  tge_handle above = tge_object_create((struct tge_game_object){ .pos = { 1, 2, 1 }, .sprite = &ship });
+
+  expect_int(below != 0 && above != 0 && below != above, 1, "handles created");
+
+  tge_present();
+  expect_int(text_is(&vt, "          \n猫>##     \n ####     \n          \n          \n"), 1, "drawn in z order");
+
+  tge_object_move(above, (struct tge_vec3){ 4, 3, 1 });
+  tge_present();
+  expect_int(text_is(&vt, "          \n ####     \n ##猫>    \n          \n          \n"), 1, "what was underneath restored");
+  expect_uint(mismatched_cells(&vt), 0, "screen matches the frame");
+
+  //moving into the same cells again changes nothing on screen
+  tge_object_move(above, (struct tge_vec3){ 4, 3, 1 });
+  tge_present();
+  expect_uint(tge_get_output_stats().frame_bytes, 0, "unchanged object not output");
+  expect_uint(tge_get_output_stats().frame_writes, 0, "unchanged frame makes no writes");
+
+  tge_object_move(above, (struct tge_vec3){ 5, 3, 1 });
+  tge_present();
+  expect_int(tge_get_output_stats().frame_bytes < 16, 1, "one cell move sends little");
+
+  expect_int(tge_object_destroy(below), 1, "destroyed");
+  expect_int(tge_object_destroy(below), 0, "stale handle rejected");
+  expect_int(tge_object_move(below, (struct tge_vec3){ 1, 1, 0 }), 0, "stale handle cannot move");
+  tge_present();
+  expect_int(text_is(&vt, "          \n          \n    猫>   \n          \n          \n"), 1, "destroyed object erased");
+
+  tge_handle reused = tge_object_create((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &wall });
+  expect_int(reused != below, 1, "reused slot gets a new handle");
+  expect_int(tge_object_get(reused)->pos.x == 1 && tge_object_get(below) == NULL, 1, "objects looked up by handle");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+  tge_sprite_destroy(&wall);
+  tge_sprite_destroy(&ship);
+  tge_vt_destroy(&vt);
+}
+
+void test_wide_glyph_damage(){
+  puts("testing wide glyphs on the edge of damage");
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 2, 10);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(2, 10);
+
+  struct tge_sprite cats = tge_sprite_create("猫猫猫");
+  struct tge_sprite hash = tge_sprite_create("#");
+  struct tge_sprite cross = tge_sprite_create("x");
+
+  //the middle cat is half covered by #, and x damages only the other half
+  //when it moves away
+  tge_object_create((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &cats });
+  tge_object_create((struct tge_game_object){ .pos = { 4, 1, 1 }, .sprite = &hash });
+  tge_handle mover = tge_object_create((struct tge_game_object){ .pos = { 3, 1, 2 }, .sprite = &cross });
+
+  tge_present();
+  expect_int(text_is(&vt, "猫x#猫    \n          \n"), 1, "drawn in z order");
+
+  tge_object_move(mover, (struct tge_vec3){ 1, 2, 2 });
+  tge_present();
+
+  expect_int(text_is(&vt, "猫 #猫    \nx         \n"), 1, "wide glyph does not cover a higher object");
+  expect_uint(mismatched_cells(&vt), 0, "screen matches the frame");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+  tge_sprite_destroy(&cats);
+  tge_sprite_destroy(&hash);
+  tge_sprite_destroy(&cross);
+  tge_vt_destroy(&vt);
+}
+
+void test_camera(){
+  puts("testing camera scrolling");
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 10, 20);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(10, 20);
+
+  //a tall map of distinct rows
+  char lines[40][21];
+  struct tge_sprite rows[40];
+  tge_handle handles[40];
+
+  for(int i = 0; i < 40; i++){
+    for(int x = 0; x < 20; x++){
+      lines[i][x] = 'a' + (i * 7 + x) % 26;
+    }
+    lines[i][20] = '\0';
+
+    rows[i] = tge_sprite_create(lines[i]);
+    handles[i] = tge_object_create((struct tge_game_object){ .pos = { 1, i + 1, 0 }, .sprite = &rows[i] });
+  }
+
+  tge_present();
+
+  unsigned int mismatched = 0;
+  size_t most_bytes = 0;
+
+  for(int y = 1; y <= 20; y++){
+    tge_set_camera(0, y);
+    tge_present();
+
+    mismatched += mismatched_cells(&vt);
+    most_bytes = tge_get_output_stats().frame_bytes > most_bytes ? tge_get_output_stats().frame_bytes : most_bytes;
+  }
+
+  expect_uint(mismatched, 0, "screen matches after scrolling down");
+  expect_uint(tge_vt_cell_at(&vt, 1, 1)->ch, lines[20][0], "top row follows the camera");
+  expect_int(most_bytes < 40, 1, "one row scroll sends about one row");
+
+  //up two rows at a time, with a fixed status row at the bottom
+  tge_set_scroll_region(1, 9);
+
+  for(int y = 18; y >= 0; y -= 2){
+    tge_set_camera(0, y);
+    tge_present();
+
+    mismatched += mismatched_cells(&vt);
+  }
+
+  expect_uint(mismatched, 0, "screen matches inside a scroll region");
+  expect_uint(vt.scroll_top * 100 + vt.scroll_bottom, 110, "scroll region reset after use");
+
+  //a move made up of several camera changes and an object move in between
+  tge_set_camera(0, 3);
+  tge_object_move(handles[0], (struct tge_vec3){ 5, 6, 1 });
+  tge_set_camera(0, 5);
+  tge_present();
+
+  expect_uint(mismatched_cells(&vt), 0, "damage before a camera move is shifted");
+
+  tge_set_camera(2, 5);
+  tge_present();
+
+  expect_uint(mismatched_cells(&vt), 0, "sideways move redraws");
+  expect_uint(vt.unknown, 0, "every sequence understood");
+
+  tge_clean();
+  expect_uint(scroll_top * 100 + scroll_bottom, 0, "scroll region ends with the session");
+  tge_set_output_backend(NULL);
+
+  for(int i = 0; i < 40; i++){
+    tge_sprite_destroy(&rows[i]);
+  }
+
+  tge_vt_destroy(&vt);
+}
+
+void test_runs(){
+  puts("testing repeated cells");
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 3, 40);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(3, 40);
+  tge_set_capabilities(TGE_CAP_REP | TGE_CAP_ECH);
+
+  struct tge_sprite floor = tge_sprite_create("==============================\n==============================");
+  struct tge_sprite post = tge_sprite_create("|");
+  struct tge_game_object object = { .pos = { 3, 1, 0 }, .sprite = &floor };
+
+  tge_present();
+  //keeps the first row from being erased to its end
+  tge_draw_game_object((struct tge_game_object){ .pos = { 38, 1, 0 }, .sprite = &post });
+  tge_draw_game_object(object);
+  tge_present();
+
+  expect_uint(mismatched_cells(&vt), 0, "repeated glyphs drawn");
+  expect_int(tge_get_output_stats().frame_bytes < 30, 1, "repeated glyphs sent once");
+
+  tge_clear_game_object(object);
+  tge_present();
+
+  expect_uint(mismatched_cells(&vt), 0, "blanks erased");
+  expect_int(tge_get_output_stats().frame_bytes < 30, 1, "blanks erased at once");
+
+  //without the capabilities every glyph is printed
+  tge_set_capabilities(0);
+  tge_draw_game_object(object);
+  tge_present();
+
+  expect_uint(mismatched_cells(&vt), 0, "drawn without repeat");
+  expect_int(tge_get_output_stats().frame_bytes >= 60, 1, "every glyph printed");
+  expect_uint(vt.unknown, 0, "every sequence understood");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+  tge_sprite_destroy(&floor);
+  tge_sprite_destroy(&post);
+  tge_vt_destroy(&vt);
+}
+
+void test_erase_background(){
+  puts("testing erasing coloured blanks");
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 2, 40);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(2, 40);
+  tge_set_capabilities(TGE_CAP_ECH);
+
+  struct tge_sprite text = tge_sprite_create("abcdefghijklmnopqrstuvwxyz");
+  struct tge_sprite blanks = tge_sprite_create("                    ");
+  struct tge_game_object panel = { .pos = { 2, 1, 1 }, .sprite = &blanks, .style = { .bg = TGE_COLOUR_INDEXED(4) } };
+
+  tge_draw_game_object((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &text });
+  tge_present();
+  tge_draw_game_object(panel);
+  tge_present();
+
+  //this terminal erases to the default background, so the panel is printed
+  expect_uint(mismatched_cells(&vt), 0, "coloured blanks kept without back colour erase");
+  expect_uint(tge_vt_cell_at(&vt, 2, 1)->bg, TGE_COLOUR_INDEXED(4), "panel background");
+
+  vt.back_colour_erase = true;
+  tge_set_capabilities(TGE_CAP_ECH | TGE_CAP_BCE);
+  tge_draw_game_object((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &text });
+  tge_present();
+  tge_draw_game_object(panel);
+  tge_present();
+
+  expect_uint(mismatched_cells(&vt), 0, "coloured blanks erased with back colour erase");
+  expect_int(tge_get_output_stats().frame_bytes < 20, 1, "erased at once");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+  tge_sprite_destroy(&text);
+  tge_sprite_destroy(&blanks);
+  tge_vt_destroy(&vt);
+}
+
+static char* captured;
+
+static size_t capture(void* data, const char* bytes, size_t length){
+  size_t* used = data;
+
+  memcpy(&captured[*used], bytes, length);
+  *used += length;
+
+  return length;
+}
+
+void test_capabilities(){
+  puts("testing capability replies and synchronized frames");
+  const char replies[] = "\x1BP>|kitty(0.35.2)\x1B\\\x1B[>1;4000;19c\x1B[?2026;2$y\x1B[?62;22c";
+  unsigned int length = sizeof(replies) - 1;
+  unsigned int offset = 0;
+  unsigned int used = 0;
+  struct probe_result result;
+
+  expect_int(parse_reply(replies, 3, &used, &result), REPLY_INCOMPLETE, "partial reply waits");
+  expect_int(parse_reply("\x1B[A", 3, &used, &result), REPLY_NONE, "key is not a reply");
+
+  while(offset < length){
+    enum probe_reply reply = parse_reply(&replies[offset], length - offset, &used, &result);
+
+    if(reply == REPLY_INCOMPLETE || reply == REPLY_NONE){
+      break;
+    }
+
+    probe_handle(reply, &result);
+    offset += used;
+  }
+
+  struct tge_capabilities found = tge_get_capabilities();
+
+  expect_uint(offset, length, "every reply parsed");
+  expect_int(strcmp(found.version, "kitty(0.35.2)"), 0, "version");
+  expect_uint(found.da1_class * 10000 + found.da2_type, 620001, "device attributes");
+  expect_uint(found.flags, TGE_CAP_SYNCHRONIZED_OUTPUT | TGE_CAP_ECH, "only reported capabilities");
+
+  char frame[256];
+  size_t frame_length = 0;
+  struct tge_output_backend backend = { capture, &frame_length };
+
+  captured = frame;
+  tge_set_output_backend(&backend);
+  tge_init_headless(3, 6);
+  tge_set_capabilities(TGE_CAP_SYNCHRONIZED_OUTPUT);
+
+  struct tge_sprite sprite = tge_sprite_create("ab");
+
+  tge_present();
+  tge_draw_game_object((struct tge_game_object){ .pos = { 2, 2, 0 }, .sprite = &sprite });
+  frame_length = 0;
+  tge_present();
+
+  size_t begin = sizeof(TGE_SYNC_BEGIN) - 1;
+  size_t end = sizeof(TGE_SYNC_END) - 1;
+
+  expect_int(frame_length > begin + end && memcmp(frame, TGE_SYNC_BEGIN, begin) == 0 &&
+             memcmp(&frame[frame_length - end], TGE_SYNC_END, end) == 0, 1, "frame wrapped in markers");
+
+  frame_length = 0;
+  tge_present();
+  expect_uint(frame_length, 0, "empty frame sends nothing");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+  tge_sprite_destroy(&sprite);
+}
+
+//every scan must find the same cells as the scalar one, whichever byte of
+//a cell differs and wherever the block boundaries fall
+void test_diff(){
+  puts("testing frame diffing");
+  struct cell a[67];
+  struct cell b[67];
+  scan_function scans[3] = { scan_scalar };
+  unsigned int scan_count = 1;
+  unsigned int wrong = 0;
+  unsigned int seed = 11;
+
+#ifdef TGE_SIMD_X86
+  if(__builtin_cpu_supports("sse2")){
+    scans[scan_count++] = scan_sse2;
+  }
+  if(__builtin_cpu_supports("avx2")){
+    scans[scan_count++] = scan_avx2;
+  }
+#endif
+
+  for(int round = 0; round < 2000; round++){
+    unsigned short count = round % 68;
+
+    for(unsigned short x = 0; x < count; x++){
+      seed = seed * 1103515245 + 12345;
+      a[x] = (struct cell){ .ch = 'a' + (seed >> 16) % 26, .fg = seed >> 8, .width = 1 };
+      b[x] = a[x];
+
+      //change one byte of about a third of the cells
+      if((seed >> 24) % 3 == 0){
+        ((unsigned char*)&b[x])[(seed >> 12) % sizeof(struct cell)] ^= 0x80;
+      }
+    }
+
+    for(unsigned short x = 0; x <= count; x++){
+      for(unsigned int i = 1; i < scan_count; i++){
+        wrong += scans[i](a, b, x, count, false) != scan_scalar(a, b, x, count, false);
+        wrong += scans[i](a, b, x, count, true) != scan_scalar(a, b, x, count, true);
+      }
+    }
+  }
+
+  expect_uint(wrong, 0, "vector scans agree with the scalar scan");
+
+  select_scan();
+  expect_int(scan_cells != NULL, 1, "scan selected");
+}
+
+void test_present(){
+  puts("testing presenting the back buffer");
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 4, 10);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(4, 10);
+
+  struct tge_sprite sprite = tge_sprite_create("ab\ncd");
+  struct tge_game_object object = { .pos = { 2, 2, 0 }, .sprite = &sprite };
+
+  tge_draw_game_object(object);
+  expect_int(text_is(&vt, "          \n          \n          \n          \n"), 1, "drawing alone shows nothing");
+
+  tge_present();
+  expect_int(text_is(&vt, "          \n ab       \n cd       \n          \n"), 1, "present shows the frame");
+  expect_uint(tge_get_output_stats().frame_writes, 1, "one write a frame");
+
+  //erasing and redrawing the same object changes nothing
+  tge_clear_game_object(object);
+  tge_draw_game_object(object);
+  tge_present();
+  expect_uint(tge_get_output_stats().frame_bytes, 0, "redraw of the same cells not output");
+
+  tge_present();
+  expect_uint(tge_get_output_stats().frame_bytes, 0, "unchanged frame not output");
+
+  //only cells that changed are sent
+  back_buffer_cell(3, 3)->ch = 'x';
+  tge_present();
+  expect_int(text_is(&vt, "          \n ab       \n cx       \n          \n"), 1, "changed cell shown");
+  expect_int(tge_get_output_stats().frame_bytes <= 8, 1, "one changed cell sends little");
+
+  tge_clear_game_object(object);
+  object.pos.x = 3;
+  tge_draw_game_object(object);
+  tge_present();
+  expect_int(text_is(&vt, "          \n  ab      \n  cd      \n          \n"), 1, "moved object");
+  expect_uint(mismatched_cells(&vt), 0, "screen matches the frame");
+
+  tge_clear_game_object(object);
+  tge_present();
+  expect_int(text_is(&vt, "          \n          \n          \n          \n"), 1, "cleared object");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+  tge_sprite_destroy(&sprite);
+  tge_vt_destroy(&vt);
+}
+
+static char motion[64];
+static size_t motion_length;
+
+//whether moving the cursor from one cell to another sends exactly expected
+static bool moves_with(unsigned short from_x, unsigned short from_y, unsigned short to_x, unsigned short to_y, const char* expected){
+  tge_cursor_x = from_x;
+  tge_cursor_y = from_y;
+  motion_length = 0;
+
+  move_cursor(to_x, to_y);
+  tge_flush();
+
+  return motion_length == strlen(expected) && memcmp(motion, expected, motion_length) == 0 &&
+         tge_cursor_x == to_x && tge_cursor_y == to_y;
+}
+
+void test_cursor_motion(){
+  puts("testing cursor motion");
+  struct tge_output_backend backend = { capture, &motion_length };
+
+  captured = motion;
+  tge_set_output_backend(&backend);
+  tge_init_headless(10, 40);
+
+  expect_int(moves_with(5, 3, 5, 3, ""), 1, "already there");
+  expect_int(moves_with(5, 3, 6, 3, " "), 1, "reprint an unchanged cell");
+
+  back_buffer_cell(5, 3)->ch = 'x';
+  expect_int(moves_with(5, 3, 6, 3, "\x1B[C"), 1, "step over a changed cell");
+  back_buffer_cell(5, 3)->ch = ' ';
+
+  expect_int(moves_with(5, 3, 3, 3, "\b\b"), 1, "backspaces");
+  expect_int(moves_with(20, 3, 10, 3, "\x1B[10D"), 1, "relative left");
+  expect_int(moves_with(3, 3, 3, 4, "\x1B[B"), 1, "relative down");
+  expect_int(moves_with(30, 8, 1, 8, "\r"), 1, "carriage return");
+  expect_int(moves_with(30, 8, 1, 1, "\x1B[H"), 1, "home");
+  expect_int(moves_with(2, 2, 25, 9, "\x1B[9;25H"), 1, "absolute");
+  expect_int(moves_with(0, 0, 5, 5, "\x1B[5;5H"), 1, "absolute from an unknown position");
+  //printing in the last column leaves the cursor waiting to wrap
+  expect_int(moves_with(41, 2, 1, 3, "\x1B[3H"), 1, "absolute after the last column");
+
+  //line feeds only return to the first column when the terminal adds CR
+  expect_int(moves_with(7, 3, 1, 5, "\x1B[5H"), 1, "no newline without CR translation");
+
+  tcflag_t saved = term_cur_flags.c_oflag;
+  term_cur_flags.c_oflag = OPOST | ONLCR;
+
+  expect_int(moves_with(7, 3, 1, 5, "\n\n"), 1, "newlines");
+
+  term_cur_flags.c_oflag = saved;
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+}
+
+//a sprite filling a 10 x 40 screen with letters starting at first
+static struct tge_sprite screen_sprite(char first){
+  char text[10 * 41 + 1];
+  size_t length = 0;
+
+  for(unsigned short y = 0; y < 10; y++){
+    for(unsigned short x = 0; x < 40; x++){
+      text[length++] = first + (x + y) % 26;
+    }
+
+    text[length++] = '\n';
+  }
+
+  text[length] = '\0';
+
+  return tge_sprite_create(text);
+}
+
+void test_output_arena(){
+  puts("testing the output arena");
+  struct tge_vt vt;
+
+  expect_int(tge_set_output_capacity(0), 0, "empty arena rejected");
+
+  tge_vt_init(&vt, 10, 40);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(10, 40);
+
+  struct tge_sprite lower = screen_sprite('a');
+  struct tge_sprite upper = screen_sprite('A');
+  unsigned long long total = tge_get_output_stats().total_bytes;
+
+  tge_draw_game_object((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &lower });
+  tge_present();
+
+  struct tge_output_stats stats = tge_get_output_stats();
+
+  expect_uint(stats.frame_writes, 1, "whole screen in one write");
+  expect_int(stats.frame_bytes >= 400, 1, "every cell sent");
+  expect_uint64_t(stats.total_bytes - total, stats.frame_bytes, "total counts the frame");
+
+  //a frame bigger than the arena is written as it fills
+  expect_int(tge_set_output_capacity(64), 1, "arena resized");
+
+  tge_draw_game_object((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &upper });
+  tge_present();
+  stats = tge_get_output_stats();
+
+  expect_int(stats.frame_writes > 1, 1, "full arena written early");
+  expect_int(stats.frame_bytes <= stats.frame_writes * 64ULL, 1, "no write bigger than the arena");
+  expect_uint(mismatched_cells(&vt), 0, "screen matches the frame");
+
+  tge_clean();
+
+  //output bigger than the whole arena skips it
+  char bytes[32];
+  size_t length = 0;
+  struct tge_output_backend capturing = { capture, &length };
+
+  captured = bytes;
+  tge_set_output_backend(&capturing);
+  tge_set_output_capacity(8);
+
+  out_literal("ab");
+  tge_set_output_capacity(16);
+  expect_uint(length, 2, "resizing writes pending output");
+
+  out_literal("0123456789abcdefg");
+  expect_uint(length, 19, "oversized output written at once");
+
+  out_literal("cd");
+  expect_uint(length, 19, "small output kept");
+  tge_flush();
+  expect_int(length == 21 && memcmp(bytes, "ab0123456789abcdefgcd", 21) == 0, 1, "output in order");
+  expect_uint(tge_get_output_stats().frame_writes, 3, "writes counted");
+
+  tge_set_output_capacity(TGE_DEFAULT_OUTPUT_CAPACITY);
+  tge_set_output_backend(NULL);
+  tge_sprite_destroy(&lower);
+  tge_sprite_destroy(&upper);
+  tge_vt_destroy(&vt);
+}
+
+void test_sprites(){
+  puts("testing sprite rows");
+  struct tge_sprite sprite = tge_sprite_create("ab\n\n猫c\xCC\x81\n");
+
+  expect_uint(sprite.height, 3, "trailing newline starts no row");
+  expect_uint(sprite.width, 3, "widest row in columns");
+  expect_uint(sprite.glyph_count, 4, "combining mark dropped");
+  expect_uint(sprite.length, strlen(sprite.text), "length of the text");
+  expect_uint(sprite.rows[0].start * 10 + sprite.rows[0].length, 2, "first row");
+  expect_uint(sprite.rows[1].start * 10 + sprite.rows[1].length, 20, "empty row");
+  expect_uint(sprite.rows[2].start * 10 + sprite.rows[2].length, 22, "last row");
+  expect_uint(sprite.glyphs[2].codepoint * 10 + sprite.glyphs[2].width, 0x732B * 10 + 2, "wide glyph");
+
+  struct tge_sprite empty = tge_sprite_create("");
+
+  expect_uint(empty.width + empty.height + empty.glyph_count, 0, "empty sprite");
+
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 3, 6);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(3, 6);
+
+  struct tge_sprite wall = tge_sprite_create("#####\n#####\n#####");
+  struct tge_game_object object = { .pos = { 2, 1, 0 }, .sprite = &sprite };
+
+  tge_draw_game_object((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &wall });
+  tge_draw_game_object(object);
+  tge_draw_game_object((struct tge_game_object){ .pos = { 1, 1, 0 }, .sprite = &empty });
+  tge_present();
+  expect_int(text_is(&vt, "#ab## \n##### \n#猫c# \n"), 1, "rows drawn, empty row left alone");
+
+  //clearing blanks the cells of each row and nothing else
+  tge_clear_game_object(object);
+  tge_present();
+  expect_int(text_is(&vt, "#  ## \n##### \n#   # \n"), 1, "rows cleared");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+  tge_sprite_destroy(&wall);
+  tge_sprite_destroy(&empty);
+  tge_sprite_destroy(&sprite);
+  tge_vt_destroy(&vt);
+}
+
+void test_clipping(){
+  puts("testing clipping to the screen");
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 4, 8);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(4, 8);
+
+  struct tge_sprite block = tge_sprite_create("abc\ndef");
+  struct tge_sprite wide_first = tge_sprite_create("猫x");
+  struct tge_sprite wide_last = tge_sprite_create("x猫");
+  struct tge_vec3 outside[] = { { -2, 1, 0 }, { 9, 1, 0 }, { 1, -1, 0 }, { 1, 5, 0 }, { -30000, -30000, 0 }, { 30000, 30000, 0 } };
+
+  tge_present();
+
+  for(unsigned int i = 0; i < sizeof(outside) / sizeof(outside[0]); i++){
+    tge_draw_game_object((struct tge_game_object){ .pos = outside[i], .sprite = &block });
+  }
+
+  tge_present();
+  expect_uint(tge_get_output_stats().frame_bytes, 0, "objects off screen draw nothing");
+
+  tge_draw_game_object((struct tge_game_object){ .pos = { -1, 1, 0 }, .sprite = &block });
+  tge_draw_game_object((struct tge_game_object){ .pos = { 7, 3, 0 }, .sprite = &block });
+  tge_draw_game_object((struct tge_game_object){ .pos = { 3, 0, 0 }, .sprite = &block });
+  //a wide glyph cut by the edge of the screen shows as a blank
+  tge_draw_game_object((struct tge_game_object){ .pos = { 0, 3, 0 }, .sprite = &wide_first });
+  tge_draw_game_object((struct tge_game_object){ .pos = { 7, 2, 0 }, .sprite = &wide_last });
+  tge_present();
+
+  expect_int(text_is(&vt, "c def   \nf     x \n x    ab\n      de\n"), 1, "visible parts drawn");
+  expect_uint(mismatched_cells(&vt), 0, "screen matches the frame");
+
+  tge_clear_game_object((struct tge_game_object){ .pos = { -1, 1, 0 }, .sprite = &block });
+  tge_clear_game_object((struct tge_game_object){ .pos = { 0, 3, 0 }, .sprite = &wide_first });
+  tge_present();
+  expect_int(text_is(&vt, "  def   \n      x \n      ab\n      de\n"), 1, "visible parts cleared");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+  tge_sprite_destroy(&block);
+  tge_sprite_destroy(&wide_first);
+  tge_sprite_destroy(&wide_last);
+  tge_vt_destroy(&vt);
+}
+
+void test_scene(){
+  puts("testing scene depth order");
+  struct tge_vt vt;
+
+  tge_vt_init(&vt, 3, 6);
+
+  struct tge_output_backend backend = tge_vt_backend(&vt);
+  tge_set_output_backend(&backend);
+  tge_init_headless(3, 6);
+
+  struct tge_sprite sprites[] = {
+    tge_sprite_create("zz"),
+    tge_sprite_create("aaa"),
+    tge_sprite_create("bbbb"),
+    tge_sprite_create("xxx"),
+    tge_sprite_create("yy")
+  };
+  struct tge_game_object objects[] = {
+    { .pos = { 1, 1, 2 }, .sprite = &sprites[0] },
+    { .pos = { 1, 1, -1 }, .sprite = &sprites[1] },
+    { .pos = { 1, 1, 1 }, .sprite = &sprites[2] },
+    { .pos = { 1, 2, 5 }, .sprite = &sprites[3] },
+    { .pos = { 2, 2, 5 }, .sprite = &sprites[4] }
+  };
+
+  tge_draw_scene(objects, 5);
+  tge_present();
+  expect_int(text_is(&vt, "zzbb  \nxyy   \n      \n"), 1, "higher z on top, later on top for equal z");
+
+  //objects already in depth order are drawn in array order
+  struct tge_game_object swapped[] = { objects[4], objects[3] };
+
+  tge_draw_scene(swapped, 2);
+  tge_draw_scene(NULL, 0);
+  tge_present();
+  expect_int(text_is(&vt, "zzbb  \nxxx   \n      \n"), 1, "equal z in array order");
+
+  tge_clean();
+
+  //cells go out in row major order whatever order objects are given in
+  char bytes[64];
+  size_t length = 0;
+  struct tge_output_backend capturing = { capture, &length };
+  struct tge_game_object scattered[] = {
+    { .pos = { 5, 3, 0 }, .sprite = &sprites[1] },
+    { .pos = { 1, 1, 0 }, .sprite = &sprites[0] }
+  };
+
+  captured = bytes;
+  tge_set_output_backend(&capturing);
+  tge_init_headless(3, 6);
+  length = 0;
+
+  tge_draw_scene(scattered, 2);
+  tge_present();
+
+  char* first = memchr(bytes, 'z', length);
+  char* last = memchr(bytes, 'a', length);
+
+  expect_int(first != NULL && last != NULL && first < last, 1, "top row sent first");
+
+  tge_clean();
+  tge_set_output_backend(NULL);
+
+  for(int i = 0; i < 5; i++){
+    tge_sprite_destroy(&sprites[i]);
+  }
+
+  tge_vt_destroy(&vt);
+}
+
+int main(){
+  test_sequences();
+  test_present();
+  test_cursor_motion();
+  test_output_arena();
+  test_sprites();
+  test_clipping();
+  test_scene();
+  test_diff();
+  test_renderer_matches();
+  test_registry();
+  test_wide_glyph_damage();
+  test_camera();
+  test_runs();
+  test_erase_background();
+  test_capabilities();
+
+  return 0;
+}